@@ -0,0 +1,491 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <common/casts.hpp>
+#include <common/chrono.hpp>
+#include <common/fastmath.hpp>
+#include <common/types.hpp>
+#include <contacts/config.hpp>
+#include <contacts/contact.hpp>
+#include <contacts/finder.hpp>
+#include <contacts/history.hpp>
+#include <contacts/tracking/config.hpp>
+#include <contacts/tracking/tracker.hpp>
+#include <core/generic/config.hpp>
+
+#include <CLI/CLI.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace iptsd::apps::bench {
+namespace {
+
+// The size of the smallest heatmap, this is the size of a typical Surface touchscreen.
+constexpr Eigen::Index BASE_ROWS = 44;
+constexpr Eigen::Index BASE_COLS = 64;
+
+// How many different frames are generated for every size.
+constexpr usize FRAMES = 16;
+
+/*
+ * How far the contacts of different detection modes may be apart, to still be the same.
+ * Vectorized sums can differ in the last bit, depending on the alignment of the buffers.
+ */
+constexpr f64 MAX_CONTACT_DIFFERENCE = 1e-9;
+
+// How many frames are generated for benchmarking contact tracking.
+constexpr usize TRACKING_FRAMES = 256;
+
+// How many random inputs every fast math function is compared against libm with.
+constexpr usize MATH_SAMPLES = 1000000;
+
+// The largest absolute error of the fast trigonometric functions, in radians.
+constexpr f64 MAX_ATAN2_ERROR = 1e-7;
+constexpr f64 MAX_SINCOS_ERROR = 1e-10;
+
+/*!
+ * Generates a sequence of synthetic heatmaps with contacts that move around.
+ *
+ * The background noise is the same in all heatmaps of the sequence, so that only the
+ * area around the contacts changes from one heatmap to the next.
+ *
+ * @param[in] rows The number of rows of the heatmaps.
+ * @param[in] cols The number of columns of the heatmaps.
+ * @param[in] contacts How many contacts are on every heatmap.
+ * @return A list of heatmaps, normalized like the heatmaps passed to the contact finder.
+ */
+std::vector<Image<f64>> generate(const Eigen::Index rows,
+                                 const Eigen::Index cols,
+                                 const usize contacts)
+{
+	std::mt19937 rng {0}; // NOLINT(cert-msc32-c,cert-msc51-cpp)
+
+	std::uniform_real_distribution<f64> x {0, casts::to<f64>(cols)};
+	std::uniform_real_distribution<f64> y {0, casts::to<f64>(rows)};
+	std::uniform_real_distribution<f64> angle {0, 2 * M_PI};
+	std::normal_distribution<f64> noise {0, 0.01};
+
+	std::vector<Vector2<f64>> start {};
+	std::vector<Vector2<f64>> direction {};
+
+	for (usize i = 0; i < contacts; i++) {
+		const f64 a = angle(rng);
+
+		start.emplace_back(x(rng), y(rng));
+		direction.emplace_back(std::cos(a), std::sin(a));
+	}
+
+	Image<f64> background {rows, cols};
+
+	for (Eigen::Index iy = 0; iy < rows; iy++) {
+		for (Eigen::Index ix = 0; ix < cols; ix++)
+			background(iy, ix) = 0.05 + noise(rng);
+	}
+
+	std::vector<Image<f64>> frames {};
+
+	for (usize f = 0; f < FRAMES; f++) {
+		Image<f64> heatmap = background;
+
+		for (usize i = 0; i < contacts; i++) {
+			const Vector2<f64> mean = start[i] + direction[i] * casts::to<f64>(f);
+
+			for (Eigen::Index iy = 0; iy < rows; iy++) {
+				for (Eigen::Index ix = 0; ix < cols; ix++) {
+					const f64 dx = casts::to<f64>(ix) - mean.x();
+					const f64 dy = casts::to<f64>(iy) - mean.y();
+
+					heatmap(iy, ix) += 0.5 * std::exp(-(dx * dx + dy * dy) / 3.0);
+				}
+			}
+		}
+
+		// Real heatmaps are sent as 8 bit values
+		heatmap = (heatmap.max(0).min(1) * 255).round() / 255;
+
+		frames.push_back(std::move(heatmap));
+	}
+
+	return frames;
+}
+
+/*!
+ * Measures how long the contact finder takes for processing a sequence of heatmaps.
+ *
+ * @param[in] config The configuration of the contact finder.
+ * @param[in] frames The heatmaps to process.
+ * @param[in] runs How many times the heatmaps are processed.
+ * @return The average time for one heatmap, in microseconds.
+ */
+f64 measure(const contacts::Config<f64> &config,
+            const std::vector<Image<f64>> &frames,
+            const usize runs)
+{
+	using clock = chrono::steady_clock;
+
+	contacts::Finder<f64> finder {config};
+	std::vector<contacts::Contact<f64>> contacts {};
+
+	// Warm up the internal buffers
+	for (const Image<f64> &frame : frames)
+		finder.find(frame, contacts);
+
+	const clock::time_point start = clock::now();
+
+	for (usize i = 0; i < runs; i++) {
+		for (const Image<f64> &frame : frames)
+			finder.find(frame, contacts);
+	}
+
+	const clock::duration duration = clock::now() - start;
+	const f64 us = chrono::duration_cast<microseconds<f64>>(duration).count();
+
+	return us / casts::to<f64>(runs * frames.size());
+}
+
+/*!
+ * Runs the contact finder once over a sequence of heatmaps.
+ *
+ * @param[in] config The configuration of the contact finder.
+ * @param[in] frames The heatmaps to process.
+ * @return The contacts that were found in every heatmap.
+ */
+std::vector<std::vector<contacts::Contact<f64>>> collect(const contacts::Config<f64> &config,
+                                                         const std::vector<Image<f64>> &frames)
+{
+	contacts::Finder<f64> finder {config};
+	std::vector<std::vector<contacts::Contact<f64>>> results {};
+
+	for (const Image<f64> &frame : frames)
+		finder.find(frame, results.emplace_back());
+
+	return results;
+}
+
+/*!
+ * Checks if two lists of contacts are the same, apart from rounding errors.
+ *
+ * @param[in] a The first list of contacts.
+ * @param[in] b The second list of contacts.
+ * @return Whether all contacts have the same properties.
+ */
+bool identical(const std::vector<contacts::Contact<f64>> &a,
+               const std::vector<contacts::Contact<f64>> &b)
+{
+	const auto same = [](const contacts::Contact<f64> &x, const contacts::Contact<f64> &y) {
+		const f64 mean = (x.mean - y.mean).cwiseAbs().maxCoeff();
+		const f64 size = (x.size - y.size).cwiseAbs().maxCoeff();
+		const f64 orientation = std::abs(x.orientation - y.orientation);
+
+		if (std::max({mean, size, orientation}) > MAX_CONTACT_DIFFERENCE)
+			return false;
+
+		return x.index == y.index && x.valid == y.valid && x.stable == y.stable;
+	};
+
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), same);
+}
+
+/*!
+ * Generates a sequence of frames with contacts that move around and cross each other.
+ *
+ * @param[in] count How many contacts are in every frame.
+ * @return A list of frames. The contact with the same position in every frame is the same finger.
+ */
+std::vector<std::vector<contacts::Contact<f64>>> generate_contacts(const usize count)
+{
+	std::mt19937 rng {0}; // NOLINT(cert-msc32-c,cert-msc51-cpp)
+
+	std::uniform_real_distribution<f64> position {0, 1};
+	std::uniform_real_distribution<f64> velocity {-0.01, 0.01};
+	std::normal_distribution<f64> noise {0, 0.001};
+
+	std::vector<contacts::Contact<f64>> fingers(count);
+	std::vector<Vector2<f64>> velocities(count);
+
+	for (usize i = 0; i < count; i++) {
+		fingers[i].mean = Vector2<f64> {position(rng), position(rng)};
+		fingers[i].size = Vector2<f64> {0.01, 0.01};
+		fingers[i].normalized = true;
+
+		velocities[i] = Vector2<f64> {velocity(rng), velocity(rng)};
+	}
+
+	std::vector<std::vector<contacts::Contact<f64>>> frames {};
+
+	for (usize f = 0; f < TRACKING_FRAMES; f++) {
+		for (usize i = 0; i < count; i++) {
+			Vector2<f64> &mean = fingers[i].mean;
+
+			mean += velocities[i] + Vector2<f64> {noise(rng), noise(rng)};
+
+			// Bounce off the edges of the screen
+			for (Eigen::Index j = 0; j < 2; j++) {
+				if (mean[j] >= 0 && mean[j] <= 1)
+					continue;
+
+				velocities[i][j] = -velocities[i][j];
+				mean[j] = std::clamp(mean[j], 0.0, 1.0);
+			}
+		}
+
+		frames.push_back(fingers);
+	}
+
+	return frames;
+}
+
+/*!
+ * Measures how long the contact tracker takes for processing a sequence of frames.
+ *
+ * @param[in] config The configuration of the contact tracker.
+ * @param[in] frames The frames to process.
+ * @param[in] runs How many times the frames are processed.
+ * @param[out] swaps How often a contact got the index of another contact in the first run.
+ * @return The average time for one frame, in microseconds.
+ */
+f64 measure_tracking(const contacts::tracking::Config<f64> &config,
+                     const std::vector<std::vector<contacts::Contact<f64>>> &frames,
+                     const usize runs,
+                     usize &swaps)
+{
+	using clock = chrono::steady_clock;
+
+	contacts::tracking::Tracker<f64> tracker {config};
+	contacts::History<f64> history {1};
+	std::vector<contacts::Contact<f64>> contacts {};
+	std::vector<std::optional<usize>> last {};
+
+	swaps = 0;
+
+	// Count the index changes, and warm up the internal buffers
+	for (const std::vector<contacts::Contact<f64>> &frame : frames) {
+		contacts = frame;
+
+		tracker.track(contacts, history);
+		history.push(contacts);
+
+		if (last.size() == contacts.size()) {
+			for (usize i = 0; i < contacts.size(); i++) {
+				if (contacts[i].index != last[i])
+					swaps++;
+			}
+		}
+
+		last.resize(contacts.size());
+
+		for (usize i = 0; i < contacts.size(); i++)
+			last[i] = contacts[i].index;
+	}
+
+	f64 us = 0;
+
+	for (usize i = 0; i < runs; i++) {
+		for (const std::vector<contacts::Contact<f64>> &frame : frames) {
+			contacts = frame;
+
+			const clock::time_point start = clock::now();
+			tracker.track(contacts, history);
+			const clock::duration duration = clock::now() - start;
+
+			history.push(contacts);
+
+			us += chrono::duration_cast<microseconds<f64>>(duration).count();
+		}
+	}
+
+	return us / casts::to<f64>(runs * frames.size());
+}
+
+/*!
+ * Compares the fast math functions against libm, and logs their largest error.
+ *
+ * @return Whether all functions stay within their accuracy budget.
+ */
+bool check_math()
+{
+	namespace fastmath = common::fastmath;
+
+	std::mt19937 rng {0}; // NOLINT(cert-msc32-c,cert-msc51-cpp)
+
+	std::uniform_real_distribution<f64> unit {-1, 1};
+	std::uniform_real_distribution<f64> turns {-4 * M_PI, 4 * M_PI};
+	std::uniform_real_distribution<f64> magnitude {-30, 30};
+
+	f64 atan2 = 0;
+	f64 asin = 0;
+	f64 sincos = 0;
+
+	for (usize i = 0; i < MATH_SAMPLES; i++) {
+		const f64 y = unit(rng);
+		const f64 x = unit(rng);
+		atan2 = std::max(atan2, std::abs(fastmath::atan2(y, x) - std::atan2(y, x)));
+
+		const f64 s = unit(rng);
+		asin = std::max(asin, std::abs(fastmath::asin(s) - std::asin(s)));
+
+		f64 sin = 0;
+		f64 cos = 0;
+
+		const f64 a = turns(rng);
+		fastmath::sincos(a, sin, cos);
+
+		sincos = std::max(sincos, std::abs(sin - std::sin(a)));
+		sincos = std::max(sincos, std::abs(cos - std::cos(a)));
+	}
+
+	const bool atan2_ok = atan2 <= MAX_ATAN2_ERROR;
+	const bool asin_ok = asin <= MAX_ATAN2_ERROR;
+	const bool sincos_ok = sincos <= MAX_SINCOS_ERROR;
+
+	spdlog::info("atan2: {:.3g} ({})", atan2, atan2_ok ? "ok" : "FAILED");
+	spdlog::info("asin: {:.3g} ({})", asin, asin_ok ? "ok" : "FAILED");
+	spdlog::info("sincos: {:.3g} ({})", sincos, sincos_ok ? "ok" : "FAILED");
+
+	bool pow_ok = true;
+
+	// The exponent of the DFT position interpolation, and a few others for comparison.
+	for (const f64 exp : {-0.7, -0.5, 0.5, 2.0}) {
+		const fastmath::Pow pow {exp};
+		f64 error = 0;
+
+		for (usize i = 0; i < MATH_SAMPLES; i++) {
+			const f64 x = std::exp2(magnitude(rng));
+			const f64 exact = std::pow(x, exp);
+
+			error = std::max(error, std::abs(pow(x) - exact) / exact);
+		}
+
+		const bool ok = error <= fastmath::Pow::TOLERANCE;
+		pow_ok = pow_ok && ok;
+
+		const char *fallback = pow.fallback() ? " using std::pow" : "";
+		spdlog::info("pow({}): {:.3g}{} ({})", exp, error, fallback, ok ? "ok" : "FAILED");
+	}
+
+	return atan2_ok && asin_ok && sincos_ok && pow_ok;
+}
+
+int run(const int argc, const char **argv)
+{
+	CLI::App app {"Utility for benchmarking contact detection on synthetic heatmaps"};
+
+	usize runs {};
+	app.add_option("RUNS", runs)
+		->description("How many times every sequence of heatmaps will be processed")
+		->check(CLI::PositiveNumber)
+		->default_val(10);
+
+	usize contacts {};
+	app.add_option("-c,--contacts", contacts)
+		->description("How many contacts are on every heatmap")
+		->default_val(10);
+
+	usize scale {};
+	app.add_option("-s,--max-scale", scale)
+		->description("How many times larger than a normal heatmap the largest heatmap is")
+		->check(CLI::PositiveNumber)
+		->default_val(8);
+
+	bool math = false;
+	app.add_flag("-m,--math", math)
+		->description("Check the accuracy of the fast math functions against libm instead");
+
+	CLI11_PARSE(app, argc, argv);
+
+	if (math)
+		return check_math() ? 0 : EXIT_FAILURE;
+
+	core::Config config {};
+	config.width = 26;
+	config.height = 17;
+
+	std::vector<std::pair<std::string, contacts::Config<f64>>> modes {};
+
+	modes.emplace_back("Full", config.contacts());
+
+	config.contacts_pyramid = true;
+	modes.emplace_back("Pyramid", config.contacts());
+	config.contacts_pyramid = false;
+
+	config.contacts_incremental = true;
+	modes.emplace_back("Incremental", config.contacts());
+	config.contacts_incremental = false;
+
+	bool consistent = true;
+
+	for (usize s = 1; s <= scale; s *= 2) {
+		const Eigen::Index rows = BASE_ROWS * casts::to_signed(s);
+		const Eigen::Index cols = BASE_COLS * casts::to_signed(s);
+
+		const std::vector<Image<f64>> frames = generate(rows, cols, contacts);
+
+		spdlog::info("Heatmap: {}x{}", cols, rows);
+
+		// All modes must find the same contacts as the full detection.
+		const auto expected = collect(modes.front().second, frames);
+
+		for (const auto &[name, cfg] : modes) {
+			const auto results = collect(cfg, frames);
+
+			const bool same = std::equal(expected.begin(),
+			                             expected.end(),
+			                             results.begin(),
+			                             results.end(),
+			                             identical);
+
+			spdlog::info("  {}: {:.2f}μs", name, measure(cfg, frames, runs));
+
+			if (!same) {
+				const std::string &full = modes.front().first;
+				spdlog::error("  {} found different contacts than {}", name, full);
+				consistent = false;
+			}
+		}
+	}
+
+	contacts::tracking::Config<f64> greedy {};
+	greedy.assignment = contacts::tracking::Assignment::GREEDY;
+
+	contacts::tracking::Config<f64> optimal {};
+	optimal.assignment = contacts::tracking::Assignment::OPTIMAL;
+
+	for (const usize count : {10, 15, 20}) {
+		const auto frames = generate_contacts(count);
+
+		usize swaps = 0;
+
+		spdlog::info("Tracking: {} contacts", count);
+
+		const f64 tgreedy = measure_tracking(greedy, frames, runs, swaps);
+		spdlog::info("  Greedy: {:.2f}μs, {} index changes", tgreedy, swaps);
+
+		const f64 toptimal = measure_tracking(optimal, frames, runs, swaps);
+		spdlog::info("  Optimal: {:.2f}μs, {} index changes", toptimal, swaps);
+	}
+
+	return consistent ? 0 : EXIT_FAILURE;
+}
+
+} // namespace
+} // namespace iptsd::apps::bench
+
+int main(const int argc, const char **argv)
+{
+	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
+
+	try {
+		return iptsd::apps::bench::run(argc, argv);
+	} catch (const std::exception &e) {
+		spdlog::error(e.what());
+		return EXIT_FAILURE;
+	}
+}
@@ -6,6 +6,7 @@
 #include "stylus.hpp"
 #include "touch.hpp"
 
+#include <common/casts.hpp>
 #include <common/types.hpp>
 #include <contacts/contact.hpp>
 #include <core/generic/application.hpp>
@@ -15,11 +16,12 @@
 
 #include <spdlog/spdlog.h>
 
+#include <string_view>
 #include <vector>
 
 namespace iptsd::apps::daemon {
 
-class Daemon : public core::Application {
+class Daemon : public core::StaticApplication<Daemon> {
 private:
 	// The touch device.
 	std::optional<TouchDevice> m_touch = std::nullopt;
@@ -29,7 +31,7 @@ private:
 
 public:
 	Daemon(const core::Config &config, const core::DeviceInfo &info)
-		: core::Application(config, info)
+		: core::StaticApplication<Daemon>(config, info)
 	{
 		const bool create_touch =
 			(m_info.is_touchscreen() && !m_config.touchscreen_disable) ||
@@ -40,9 +42,13 @@ public:
 
 		if (m_info.is_touchscreen() && !m_config.stylus_disable)
 			m_stylus.emplace(config, info);
+
+		// Without a touch device, the contacts would be thrown away.
+		if (!m_touch.has_value())
+			this->set_touch_demand(false);
 	}
 
-	void on_start() override
+	void on_start()
 	{
 		if (!m_touch.has_value() && m_info.is_touchscreen())
 			spdlog::warn("Touchscreen is disabled!");
@@ -54,39 +60,84 @@ public:
 			spdlog::warn("Stylus is disabled!");
 	}
 
-	void on_touch(const std::vector<contacts::Contact<f64>> &contacts) override
+	void on_stop()
+	{
+		if (this->missed_frames() > 0)
+			spdlog::info("Missed {} frames", this->missed_frames());
+
+		if (this->suspended_frames() > 0)
+			spdlog::info("Skipped detection for {} frames", this->suspended_frames());
+
+		if (m_touch.has_value())
+			Daemon::log_events("Touch", m_touch->emitted(), m_touch->suppressed());
+
+		if (m_stylus.has_value())
+			Daemon::log_events("Stylus", m_stylus->emitted(), m_stylus->suppressed());
+	}
+
+	void on_touch(const std::vector<contacts::Contact<f64>> &contacts)
 	{
 		if (!m_touch.has_value())
 			return;
 
 		// Enable the touchscreen if it was disabled by a stylus that is no longer active.
 		if (m_config.touchscreen_disable_on_stylus && m_stylus.has_value()) {
-			if (!m_stylus->active() && !m_touch->enabled())
+			if (!m_stylus->active() && !m_touch->enabled()) {
 				m_touch->enable();
+				this->set_touch_demand(true);
+			}
 		}
 
-		m_touch->update(contacts);
+		m_touch->update(contacts, m_timestamp);
 	}
 
-	void on_button(const ipts::samples::Button &button) override
+	void on_button(const ipts::samples::Button &button)
 	{
 		if (!m_touch.has_value())
 			return;
 
-		m_touch->update(button);
+		m_touch->update(button, m_timestamp);
 	}
 
-	void on_stylus(const ipts::samples::Stylus &stylus) override
+	void on_stylus(const ipts::samples::Stylus &stylus)
 	{
 		if (!m_stylus.has_value())
 			return;
 
 		if (m_config.touchscreen_disable_on_stylus && m_touch.has_value()) {
-			if (m_touch->enabled())
+			if (m_touch->enabled()) {
 				m_touch->disable();
+				this->set_touch_demand(false);
+			}
 		}
 
-		m_stylus->update(stylus);
+		m_stylus->update(stylus, m_timestamp);
+	}
+
+private:
+	/*!
+	 * Logs how many input events of a device were passed to the kernel.
+	 *
+	 * @param[in] name The name of the device.
+	 * @param[in] emitted How many events were emitted.
+	 * @param[in] suppressed How many events were dropped because nothing changed.
+	 */
+	static void log_events(const std::string_view name,
+	                       const usize emitted,
+	                       const usize suppressed)
+	{
+		const usize total = emitted + suppressed;
+
+		if (total == 0)
+			return;
+
+		const f64 rate = casts::to<f64>(suppressed) / casts::to<f64>(total) * 100;
+
+		spdlog::info("{}: Emitted {} events, suppressed {} ({:.1f}%)",
+		             name,
+		             emitted,
+		             suppressed,
+		             rate);
 	}
 };
 
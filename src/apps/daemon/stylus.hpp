@@ -6,6 +6,7 @@
 #include "uinput-device.hpp"
 
 #include <common/casts.hpp>
+#include <common/fastmath.hpp>
 #include <common/types.hpp>
 #include <core/generic/config.hpp>
 #include <core/generic/device.hpp>
@@ -18,6 +19,7 @@
 #include <climits>
 #include <cmath>
 #include <memory>
+#include <optional>
 
 namespace iptsd::apps::daemon {
 
@@ -27,6 +29,26 @@ private:
 	constexpr static usize MAX_Y = 7200;
 	constexpr static usize MAX_P = 4096;
 
+	/*
+	 * The values that were last emitted for every key and axis of the stylus.
+	 * Values that are not known are empty, and will always be emitted.
+	 */
+	struct State {
+	public:
+		std::optional<i32> touch = std::nullopt;
+		std::optional<i32> pen = std::nullopt;
+		std::optional<i32> rubber = std::nullopt;
+		std::optional<i32> button = std::nullopt;
+
+		std::optional<i32> x = std::nullopt;
+		std::optional<i32> y = std::nullopt;
+		std::optional<i32> pressure = std::nullopt;
+		std::optional<i32> timestamp = std::nullopt;
+
+		std::optional<i32> tilt_x = std::nullopt;
+		std::optional<i32> tilt_y = std::nullopt;
+	};
+
 private:
 	std::shared_ptr<UinputDevice> m_uinput = std::make_shared<UinputDevice>();
 
@@ -39,6 +61,12 @@ private:
 	// The last known state of the stylus.
 	ipts::samples::Stylus m_last;
 
+	// The values that were last emitted.
+	State m_state {};
+
+	// The time at which the current state was captured by the device, in microseconds.
+	u32 m_timestamp = 0;
+
 public:
 	StylusDevice(const core::Config &config, const core::DeviceInfo &info)
 	{
@@ -48,6 +76,9 @@ public:
 
 		m_uinput->set_evbit(EV_KEY);
 		m_uinput->set_evbit(EV_ABS);
+		m_uinput->set_evbit(EV_MSC);
+
+		m_uinput->set_mscbit(MSC_TIMESTAMP);
 
 		m_uinput->set_propbit(INPUT_PROP_DIRECT);
 		m_uinput->set_propbit(INPUT_PROP_POINTER);
@@ -78,10 +109,12 @@ public:
 	 * Passes stylus data to the linux kernel.
 	 *
 	 * @param[in] data The current state of the stylus.
+	 * @param[in] timestamp When the state was captured by the device, in microseconds.
 	 */
-	void update(const ipts::samples::Stylus &data)
+	void update(const ipts::samples::Stylus &data, const u32 timestamp)
 	{
 		m_active = data.proximity;
+		m_timestamp = timestamp;
 
 		// Switching tools within one frame causes issues, lift the stylus for one frame.
 		if (m_last.rubber != data.rubber)
@@ -94,18 +127,20 @@ public:
 			const i32 y = casts::to<i32>(std::round(data.y * MAX_Y));
 			const i32 pressure = casts::to<i32>(std::round(data.pressure * MAX_P));
 
-			m_uinput->emit(EV_KEY, BTN_TOUCH, data.contact ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_PEN, !data.rubber ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_RUBBER, data.rubber ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_STYLUS, data.button ? 1 : 0);
+			State &last = m_state;
 
-			m_uinput->emit(EV_ABS, ABS_X, x);
-			m_uinput->emit(EV_ABS, ABS_Y, y);
-			m_uinput->emit(EV_ABS, ABS_PRESSURE, pressure);
-			m_uinput->emit(EV_ABS, ABS_MISC, data.timestamp);
+			m_uinput->emit(EV_KEY, BTN_TOUCH, data.contact ? 1 : 0, last.touch);
+			m_uinput->emit(EV_KEY, BTN_TOOL_PEN, !data.rubber ? 1 : 0, last.pen);
+			m_uinput->emit(EV_KEY, BTN_TOOL_RUBBER, data.rubber ? 1 : 0, last.rubber);
+			m_uinput->emit(EV_KEY, BTN_STYLUS, data.button ? 1 : 0, last.button);
 
-			m_uinput->emit(EV_ABS, ABS_TILT_X, tilt.x());
-			m_uinput->emit(EV_ABS, ABS_TILT_Y, tilt.y());
+			m_uinput->emit(EV_ABS, ABS_X, x, last.x);
+			m_uinput->emit(EV_ABS, ABS_Y, y, last.y);
+			m_uinput->emit(EV_ABS, ABS_PRESSURE, pressure, last.pressure);
+			m_uinput->emit(EV_ABS, ABS_MISC, data.timestamp, last.timestamp);
+
+			m_uinput->emit(EV_ABS, ABS_TILT_X, tilt.x(), last.tilt_x);
+			m_uinput->emit(EV_ABS, ABS_TILT_Y, tilt.y(), last.tilt_y);
 		} else {
 			this->lift();
 		}
@@ -156,6 +191,26 @@ public:
 		return m_active;
 	}
 
+	/*!
+	 * How many events were passed to the linux kernel.
+	 *
+	 * @return The number of emitted events.
+	 */
+	[[nodiscard]] usize emitted() const
+	{
+		return m_uinput->emitted();
+	}
+
+	/*!
+	 * How many events were dropped, because they were identical to the last emitted ones.
+	 *
+	 * @return The number of suppressed events.
+	 */
+	[[nodiscard]] usize suppressed() const
+	{
+		return m_uinput->suppressed();
+	}
+
 private:
 	/*!
 	 * Calculates the tilt of the stylus on X and Y axis.
@@ -169,14 +224,16 @@ private:
 		if (altitude <= 0)
 			return Vector2<i32>::Zero();
 
-		const f64 sin_alt = std::sin(altitude);
-		const f64 sin_azm = std::sin(azimuth);
+		f64 sin_alt = 0;
+		f64 cos_alt = 0;
+		common::fastmath::sincos(altitude, sin_alt, cos_alt);
 
-		const f64 cos_alt = std::cos(altitude);
-		const f64 cos_azm = std::cos(azimuth);
+		f64 sin_azm = 0;
+		f64 cos_azm = 0;
+		common::fastmath::sincos(azimuth, sin_azm, cos_azm);
 
-		const f64 atan_x = std::atan2(cos_alt, sin_alt * cos_azm);
-		const f64 atan_y = std::atan2(cos_alt, sin_alt * sin_azm);
+		const f64 atan_x = common::fastmath::atan2(cos_alt, sin_alt * cos_azm);
+		const f64 atan_y = common::fastmath::atan2(cos_alt, sin_alt * sin_azm);
 
 		const i32 tx = 9000 - casts::to<i32>(std::round(atan_x * 4500 / M_PI_4));
 		const i32 ty = casts::to<i32>(std::round(atan_y * 4500 / M_PI_4)) - 9000;
@@ -187,12 +244,12 @@ private:
 	/*!
 	 * Lifts the stylus input.
 	 */
-	void lift() const
+	void lift()
 	{
-		m_uinput->emit(EV_KEY, BTN_TOUCH, 0);
-		m_uinput->emit(EV_KEY, BTN_TOOL_PEN, 0);
-		m_uinput->emit(EV_KEY, BTN_TOOL_RUBBER, 0);
-		m_uinput->emit(EV_KEY, BTN_STYLUS, 0);
+		m_uinput->emit(EV_KEY, BTN_TOUCH, 0, m_state.touch);
+		m_uinput->emit(EV_KEY, BTN_TOOL_PEN, 0, m_state.pen);
+		m_uinput->emit(EV_KEY, BTN_TOOL_RUBBER, 0, m_state.rubber);
+		m_uinput->emit(EV_KEY, BTN_STYLUS, 0, m_state.button);
 	}
 
 	/*!
@@ -200,7 +257,11 @@ private:
 	 */
 	void sync() const
 	{
-		m_uinput->emit(EV_SYN, SYN_REPORT, 0);
+		// Only send the timestamp together with other events.
+		if (m_uinput->pending())
+			m_uinput->emit(EV_MSC, MSC_TIMESTAMP, gsl::narrow_cast<i32>(m_timestamp));
+
+		m_uinput->report();
 	}
 };
 
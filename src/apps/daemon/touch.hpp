@@ -17,11 +17,10 @@
 #include <linux/input-event-codes.h>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
-#include <iterator>
 #include <memory>
 #include <optional>
-#include <set>
 #include <vector>
 
 namespace iptsd::apps::daemon {
@@ -30,6 +29,20 @@ class TouchDevice {
 private:
 	constexpr static usize MAX_CONTACTS = 16;
 
+	/*
+	 * The number of multitouch slots.
+	 * The absinfo ranges are inclusive, so slots 0 to MAX_CONTACTS are advertised.
+	 */
+	constexpr static usize SLOT_COUNT = MAX_CONTACTS + 1;
+
+	/*
+	 * A set of multitouch slots, one bit per slot.
+	 * Contacts with an index that doesn't fit into a slot are ignored.
+	 */
+	using Slots = u32;
+
+	static_assert(SLOT_COUNT <= sizeof(Slots) * 8);
+
 	constexpr static usize MAX_X = 9600;
 	constexpr static usize MAX_Y = 7200;
 
@@ -38,6 +51,41 @@ private:
 	 */
 	constexpr static usize DIAGONAL = 12000;
 
+	/*
+	 * The keys that tell a touchpad how many fingers are touching it (1 to 5).
+	 */
+	constexpr static std::array<u16, 5> TOOLS = {
+		BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP,
+		BTN_TOOL_QUADTAP, BTN_TOOL_QUINTTAP,
+	};
+
+	/*
+	 * The values that were last emitted for a multitouch slot.
+	 * Values that are not known are empty, and will always be emitted.
+	 */
+	struct SlotState {
+	public:
+		std::optional<i32> tracking_id = std::nullopt;
+		std::optional<i32> x = std::nullopt;
+		std::optional<i32> y = std::nullopt;
+		std::optional<i32> orientation = std::nullopt;
+		std::optional<i32> major = std::nullopt;
+		std::optional<i32> minor = std::nullopt;
+	};
+
+	/*
+	 * The values that were last emitted through the singletouch API.
+	 */
+	struct SingleState {
+	public:
+		std::optional<i32> touch = std::nullopt;
+		std::optional<i32> left = std::nullopt;
+		std::optional<i32> x = std::nullopt;
+		std::optional<i32> y = std::nullopt;
+
+		std::array<std::optional<i32>, TOOLS.size()> tools {};
+	};
+
 private:
 	std::shared_ptr<UinputDevice> m_uinput = std::make_shared<UinputDevice>();
 
@@ -54,13 +102,13 @@ private:
 	bool m_disable_on_palm = false;
 
 	// The indices of the contacts in the current frame.
-	std::set<usize> m_current {};
+	Slots m_current = 0;
 
 	// The indices of the contacts in the last frame.
-	std::set<usize> m_last {};
+	Slots m_last = 0;
 
 	// The difference between m_last and m_current.
-	std::set<usize> m_lift {};
+	Slots m_lift = 0;
 
 	// The index of the contact that is emitted through the singletouch API.
 	usize m_single_index = 0;
@@ -68,6 +116,18 @@ private:
 	// Whether the device is enabled.
 	bool m_enabled = true;
 
+	// The multitouch slot that was last selected.
+	std::optional<i32> m_slot = std::nullopt;
+
+	// The values that were last emitted for every multitouch slot.
+	std::array<SlotState, SLOT_COUNT> m_slots {};
+
+	// The values that were last emitted through the singletouch API.
+	SingleState m_single {};
+
+	// The time at which the current inputs were captured by the device, in microseconds.
+	u32 m_timestamp = 0;
+
 public:
 	TouchDevice(const core::Config &config, const core::DeviceInfo &info)
 		: m_config {config},
@@ -83,6 +143,9 @@ public:
 
 		m_uinput->set_evbit(EV_ABS);
 		m_uinput->set_evbit(EV_KEY);
+		m_uinput->set_evbit(EV_MSC);
+
+		m_uinput->set_mscbit(MSC_TIMESTAMP);
 
 		m_uinput->set_keybit(BTN_TOUCH);
 
@@ -130,13 +193,16 @@ public:
 	 * Passes a frame of detected contacts to the linux kernel.
 	 *
 	 * @param[in] contacts All currently active contacts.
+	 * @param[in] timestamp When the contacts were captured by the device, in microseconds.
 	 */
-	void update(const std::vector<contacts::Contact<f64>> &contacts)
+	void update(const std::vector<contacts::Contact<f64>> &contacts, const u32 timestamp)
 	{
 		// If the touch device is disabled ignore all inputs.
 		if (!m_enabled)
 			return;
 
+		m_timestamp = timestamp;
+
 		// Find the inputs that need to be lifted
 		this->search_lifted(contacts);
 
@@ -152,14 +218,17 @@ public:
 	 * Passes a sample of the touchpad button to the linux kernel.
 	 *
 	 * @param[in] button The state of the touchpad button (pressed / released).
+	 * @param[in] timestamp When the button was captured by the device, in microseconds.
 	 */
-	void update(const ipts::samples::Button &button)
+	void update(const ipts::samples::Button &button, const u32 timestamp)
 	{
 		// If the touch device is disabled ignore all inputs.
 		if (!m_enabled)
 			return;
 
-		m_uinput->emit(EV_KEY, BTN_LEFT, button.active ? 1 : 0);
+		m_timestamp = timestamp;
+
+		m_uinput->emit(EV_KEY, BTN_LEFT, button.active ? 1 : 0, m_single.left);
 		this->sync();
 	}
 
@@ -174,9 +243,9 @@ public:
 		this->lift_all();
 		this->sync();
 
-		m_current.clear();
-		m_last.clear();
-		m_lift.clear();
+		m_current = 0;
+		m_last = 0;
+		m_lift = 0;
 	}
 
 	/*!
@@ -204,7 +273,27 @@ public:
 	 */
 	[[nodiscard]] bool active() const
 	{
-		return !m_current.empty();
+		return m_current != 0;
+	}
+
+	/*!
+	 * How many events were passed to the linux kernel.
+	 *
+	 * @return The number of emitted events.
+	 */
+	[[nodiscard]] usize emitted() const
+	{
+		return m_uinput->emitted();
+	}
+
+	/*!
+	 * How many events were dropped, because they were identical to the last emitted ones.
+	 *
+	 * @return The number of suppressed events.
+	 */
+	[[nodiscard]] usize suppressed() const
+	{
+		return m_uinput->suppressed();
 	}
 
 private:
@@ -216,26 +305,19 @@ private:
 	 */
 	void search_lifted(const std::vector<contacts::Contact<f64>> &contacts)
 	{
-		std::swap(m_current, m_last);
-
-		m_current.clear();
+		m_last = m_current;
+		m_current = 0;
 
 		// Build a set of current indices
 		for (const contacts::Contact<f64> &contact : contacts) {
 			if (!contact.index.has_value())
 				continue;
 
-			m_current.insert(contact.index.value());
+			m_current |= TouchDevice::slot(contact.index.value());
 		}
 
-		m_lift.clear();
-
 		// Determine all indices that were in the last frame but not in this one
-		std::set_difference(m_last.cbegin(),
-		                    m_last.cend(),
-		                    m_current.cbegin(),
-		                    m_current.cend(),
-		                    std::inserter(m_lift, m_lift.begin()));
+		m_lift = m_last & ~m_current;
 	}
 
 	/*!
@@ -273,6 +355,10 @@ private:
 
 			const usize index = contact.index.value();
 
+			// Ignore contacts that don't fit into a slot
+			if (index >= SLOT_COUNT)
+				continue;
+
 			// Ignore unstable changes
 			if (!contact.stable.value_or(true))
 				continue;
@@ -297,8 +383,9 @@ private:
 			}
 		}
 
-		for (const usize &index : m_lift)
+		TouchDevice::for_each(m_lift, [&](const usize index) {
 			this->lift_multitouch(index);
+		});
 
 		if (reset_singletouch) {
 			this->lift_singletouch();
@@ -311,7 +398,7 @@ private:
 
 				const usize index = contact.index.value();
 
-				if (index == m_single_index)
+				if (index == m_single_index || index >= SLOT_COUNT)
 					continue;
 
 				if (!contact.valid.value_or(true))
@@ -325,11 +412,13 @@ private:
 
 	/*!
 	 * Emits a lift event using the linux multitouch protocol.
+	 *
+	 * @param[in] index The index of the contact to lift.
 	 */
-	void lift_multitouch(const usize index) const
+	void lift_multitouch(const usize index)
 	{
-		m_uinput->emit(EV_ABS, ABS_MT_SLOT, casts::to<i32>(index));
-		m_uinput->emit(EV_ABS, ABS_MT_TRACKING_ID, -1);
+		SlotState &last = m_slots[index];
+		this->emit_slot(index, ABS_MT_TRACKING_ID, -1, last.tracking_id);
 	}
 
 	/*!
@@ -337,7 +426,7 @@ private:
 	 *
 	 * @param[in] contact The contact to emit.
 	 */
-	void emit_multitouch(const contacts::Contact<f64> &contact) const
+	void emit_multitouch(const contacts::Contact<f64> &contact)
 	{
 		const Vector2<f64> size = contact.size;
 
@@ -346,7 +435,7 @@ private:
 		mean.x() = std::clamp(mean.x(), 0.0, 1.0);
 		mean.y() = std::clamp(mean.y(), 0.0, 1.0);
 
-		const i32 index = casts::to<i32>(contact.index.value_or(0));
+		const usize index = contact.index.value_or(0);
 
 		const i32 x = casts::to<i32>(std::round(mean.x() * MAX_X));
 		const i32 y = casts::to<i32>(std::round(mean.y() * MAX_Y));
@@ -355,14 +444,35 @@ private:
 		const i32 major = casts::to<i32>(std::round(size.maxCoeff() * DIAGONAL));
 		const i32 minor = casts::to<i32>(std::round(size.minCoeff() * DIAGONAL));
 
-		m_uinput->emit(EV_ABS, ABS_MT_SLOT, index);
-		m_uinput->emit(EV_ABS, ABS_MT_TRACKING_ID, index);
-		m_uinput->emit(EV_ABS, ABS_MT_POSITION_X, x);
-		m_uinput->emit(EV_ABS, ABS_MT_POSITION_Y, y);
+		SlotState &last = m_slots[index];
+
+		this->emit_slot(index, ABS_MT_TRACKING_ID, casts::to<i32>(index), last.tracking_id);
+		this->emit_slot(index, ABS_MT_POSITION_X, x, last.x);
+		this->emit_slot(index, ABS_MT_POSITION_Y, y, last.y);
 
-		m_uinput->emit(EV_ABS, ABS_MT_ORIENTATION, angle);
-		m_uinput->emit(EV_ABS, ABS_MT_TOUCH_MAJOR, major);
-		m_uinput->emit(EV_ABS, ABS_MT_TOUCH_MINOR, minor);
+		this->emit_slot(index, ABS_MT_ORIENTATION, angle, last.orientation);
+		this->emit_slot(index, ABS_MT_TOUCH_MAJOR, major, last.major);
+		this->emit_slot(index, ABS_MT_TOUCH_MINOR, minor, last.minor);
+	}
+
+	/*!
+	 * Emits an axis of a multitouch slot, if its value has changed.
+	 *
+	 * The slot is only selected if a value has to be emitted for it.
+	 *
+	 * @param[in] index The index of the slot.
+	 * @param[in] code The axis to emit.
+	 * @param[in] value The new value of the axis.
+	 * @param[in,out] last The value that was last emitted for the axis in this slot.
+	 */
+	void emit_slot(const usize index, const u16 code, const i32 value, std::optional<i32> &last)
+	{
+		const i32 slot = casts::to<i32>(index);
+
+		if (last != value && m_slot != slot)
+			m_uinput->emit(EV_ABS, ABS_MT_SLOT, slot, m_slot);
+
+		m_uinput->emit(EV_ABS, code, value, last);
 	}
 
 	/*!
@@ -372,7 +482,7 @@ private:
 	 */
 	void process_singletouch(const std::vector<contacts::Contact<f64>> &contacts)
 	{
-		const bool reset = m_lift.find(m_single_index) == m_lift.cend();
+		const bool reset = (m_lift & TouchDevice::slot(m_single_index)) == 0;
 
 		if (!reset) {
 			for (const contacts::Contact<f64> &contact : contacts) {
@@ -413,17 +523,15 @@ private:
 	/*!
 	 * Emits a lift event using the linux singletouch protocol.
 	 */
-	void lift_singletouch() const
+	void lift_singletouch()
 	{
-		m_uinput->emit(EV_KEY, BTN_TOUCH, 0);
+		m_uinput->emit(EV_KEY, BTN_TOUCH, 0, m_single.touch);
 
 		if (m_info.is_touchpad()) {
-			m_uinput->emit(EV_KEY, BTN_LEFT, 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_FINGER, 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_DOUBLETAP, 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_TRIPLETAP, 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_QUADTAP, 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_QUINTTAP, 0);
+			m_uinput->emit(EV_KEY, BTN_LEFT, 0, m_single.left);
+
+			for (usize i = 0; i < TOOLS.size(); i++)
+				m_uinput->emit(EV_KEY, TOOLS[i], 0, m_single.tools[i]);
 		}
 	}
 
@@ -432,7 +540,7 @@ private:
 	 *
 	 * @param[in] contact The contact to emit.
 	 */
-	void emit_singletouch(const contacts::Contact<f64> &contact) const
+	void emit_singletouch(const contacts::Contact<f64> &contact)
 	{
 		Vector2<f64> mean = contact.mean;
 
@@ -442,44 +550,76 @@ private:
 		const i32 x = casts::to<i32>(std::round(mean.x() * MAX_X));
 		const i32 y = casts::to<i32>(std::round(mean.y() * MAX_Y));
 
-		m_uinput->emit(EV_KEY, BTN_TOUCH, 1);
+		m_uinput->emit(EV_KEY, BTN_TOUCH, 1, m_single.touch);
 
 		if (m_info.is_touchpad()) {
-			m_uinput->emit(EV_KEY, BTN_TOOL_FINGER, m_current.size() == 1 ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_DOUBLETAP, m_current.size() == 2 ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_TRIPLETAP, m_current.size() == 3 ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_QUADTAP, m_current.size() == 4 ? 1 : 0);
-			m_uinput->emit(EV_KEY, BTN_TOOL_QUINTTAP, m_current.size() >= 5 ? 1 : 0);
+			// The last tool is used for five or more fingers.
+			const usize fingers = casts::to<usize>(__builtin_popcount(m_current));
+			const usize count = std::min(fingers, TOOLS.size());
+
+			for (usize i = 0; i < TOOLS.size(); i++) {
+				const i32 active = count == i + 1 ? 1 : 0;
+				m_uinput->emit(EV_KEY, TOOLS[i], active, m_single.tools[i]);
+			}
 		}
 
-		m_uinput->emit(EV_ABS, ABS_X, x);
-		m_uinput->emit(EV_ABS, ABS_Y, y);
+		m_uinput->emit(EV_ABS, ABS_X, x, m_single.x);
+		m_uinput->emit(EV_ABS, ABS_Y, y, m_single.y);
 	}
 
 	/*!
 	 * Lifts all currently active inputs.
 	 */
-	void lift_all() const
+	void lift_all()
 	{
-		for (const usize &index : m_current) {
-			m_uinput->emit(EV_ABS, ABS_MT_SLOT, casts::to<i32>(index));
-			this->lift_multitouch(index);
-		}
-
-		for (const usize &index : m_last) {
-			m_uinput->emit(EV_ABS, ABS_MT_SLOT, casts::to<i32>(index));
+		TouchDevice::for_each(m_current | m_last, [&](const usize index) {
 			this->lift_multitouch(index);
-		}
+		});
 
 		this->lift_singletouch();
 	}
 
+	/*!
+	 * The slot of a contact.
+	 *
+	 * @param[in] index The index of the contact.
+	 * @return A set that only contains the slot of the contact, or nothing if it doesn't fit.
+	 */
+	static Slots slot(const usize index)
+	{
+		if (index >= SLOT_COUNT)
+			return 0;
+
+		return Slots {1} << index;
+	}
+
+	/*!
+	 * Calls a function for every slot in a set, in ascending order.
+	 *
+	 * @param[in] slots The set of slots.
+	 * @param[in] func The function to call with the index of every slot.
+	 */
+	template <class Func>
+	static void for_each(Slots slots, Func &&func)
+	{
+		while (slots != 0) {
+			func(casts::to<usize>(__builtin_ctz(slots)));
+
+			// Clear the lowest set bit
+			slots &= slots - 1;
+		}
+	}
+
 	/*!
 	 * Commits the emitted events to the linux kernel.
 	 */
 	void sync() const
 	{
-		m_uinput->emit(EV_SYN, SYN_REPORT, 0);
+		// Only send the timestamp together with other events.
+		if (m_uinput->pending())
+			m_uinput->emit(EV_MSC, MSC_TIMESTAMP, gsl::narrow_cast<i32>(m_timestamp));
+
+		m_uinput->report();
 	}
 };
 
@@ -11,6 +11,7 @@
 
 #include <exception>
 #include <fcntl.h>
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -28,6 +29,15 @@ private:
 	// The file descriptor of the open uinput node.
 	int m_fd;
 
+	// How many events were written to the device.
+	usize m_emitted = 0;
+
+	// How many events were not written, because they would not have changed anything.
+	usize m_suppressed = 0;
+
+	// Whether events were written since the last report.
+	bool m_pending = false;
+
 public:
 	UinputDevice() : m_fd {syscalls::open("/dev/uinput", O_WRONLY | O_NONBLOCK)} {};
 
@@ -125,6 +135,18 @@ public:
 		syscalls::ioctl(m_fd, UI_SET_KEYBIT, key);
 	}
 
+	/*!
+	 * Enables a miscellaneous event for this device.
+	 *
+	 * Must be called before @ref create().
+	 *
+	 * @param[in] msc The event to enable (e.g. MSC_TIMESTAMP).
+	 */
+	void set_mscbit(const i32 msc) const
+	{
+		syscalls::ioctl(m_fd, UI_SET_MSCBIT, msc);
+	}
+
 	/*!
 	 * Enables an axis event for this device.
 	 *
@@ -178,7 +200,7 @@ public:
 	 * @param[in] key The key of the button or axis.
 	 * @param[in] value The value of the button or axis.
 	 */
-	void emit(const u16 type, const u16 key, const i32 value) const
+	void emit(const u16 type, const u16 key, const i32 value)
 	{
 		struct input_event ie {};
 
@@ -187,6 +209,80 @@ public:
 		ie.value = value;
 
 		syscalls::write(m_fd, ie);
+
+		m_emitted++;
+		m_pending = true;
+	}
+
+	/*!
+	 * Emits an event, but only if its value is different from the last emitted value.
+	 *
+	 * The kernel drops events that don't change the state of the device anyway,
+	 * but only after they have been copied from userspace.
+	 *
+	 * Must be called after @ref create().
+	 *
+	 * @param[in] type The event type.
+	 * @param[in] key The key of the button or axis.
+	 * @param[in] value The value of the button or axis.
+	 * @param[in,out] last The value that was last emitted. Empty if it is not known.
+	 */
+	void emit(const u16 type, const u16 key, const i32 value, std::optional<i32> &last)
+	{
+		if (last == value) {
+			m_suppressed++;
+			return;
+		}
+
+		this->emit(type, key, value);
+		last = value;
+	}
+
+	/*!
+	 * Commits the emitted events, if any events were emitted since the last report.
+	 *
+	 * Skipped reports are not counted as suppressed events, so that the statistics only
+	 * cover events that carry a value.
+	 *
+	 * Must be called after @ref create().
+	 */
+	void report()
+	{
+		if (!m_pending)
+			return;
+
+		this->emit(EV_SYN, SYN_REPORT, 0);
+		m_pending = false;
+	}
+
+	/*!
+	 * Whether events were emitted since the last report.
+	 *
+	 * @return true if the next report will commit any events.
+	 */
+	[[nodiscard]] bool pending() const
+	{
+		return m_pending;
+	}
+
+	/*!
+	 * How many events were written to the device.
+	 *
+	 * @return The number of emitted events.
+	 */
+	[[nodiscard]] usize emitted() const
+	{
+		return m_emitted;
+	}
+
+	/*!
+	 * How many events were dropped, because they would not have changed anything.
+	 *
+	 * @return The number of suppressed events.
+	 */
+	[[nodiscard]] usize suppressed() const
+	{
+		return m_suppressed;
 	}
 };
 
@@ -10,19 +10,108 @@
 #include <core/linux/signal-handler.hpp>
 
 #include <CLI/CLI.hpp>
+#include <Eigen/Core>
 #include <gsl/gsl>
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstddef>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
+#include <new>
 #include <string>
 
 namespace iptsd::apps::perf {
 namespace {
 
+// Whether calls to operator new are currently being counted.
+std::atomic_bool g_counting = false;
+
+// How often operator new was called while counting.
+std::atomic<usize> g_allocations = 0;
+
+/*!
+ * Counts how often memory is allocated while running a function.
+ *
+ * This counts every call to operator new, including the ones from other threads.
+ * Eigen allocates its matrices with std::malloc, so the global operator new doesn't see them.
+ * Instead, iptsd-perf is built with EIGEN_RUNTIME_NO_MALLOC, and Eigen is told to forbid
+ * allocations while the function runs. An allocation by Eigen will then fail its assertion
+ * and abort. Since that is a regular assertion, it is disabled if NDEBUG is defined.
+ *
+ * @param[in] func The function to run.
+ * @return How often operator new was called while running the function.
+ */
+template <class Func>
+usize count_allocations(Func &&func)
+{
+	g_allocations = 0;
+	g_counting = true;
+
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+	Eigen::internal::set_is_malloc_allowed(false);
+#endif
+
+	func();
+
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+	Eigen::internal::set_is_malloc_allowed(true);
+#endif
+
+	g_counting = false;
+	return g_allocations;
+}
+
+/*!
+ * Allocates memory and counts the allocation, if requested.
+ *
+ * @param[in] size The size of the allocation in bytes.
+ * @param[in] alignment The alignment of the allocation in bytes.
+ * @return A pointer to the allocated memory.
+ */
+void *allocate(std::size_t size, const std::size_t alignment)
+{
+	if (g_counting.load(std::memory_order_relaxed))
+		g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	// Allocations of size 0 must still return a unique pointer.
+	size = std::max<std::size_t>(size, 1);
+
+	void *ptr = nullptr;
+
+	if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+		ptr = std::malloc(size);
+	} else {
+		// The size has to be a multiple of the alignment.
+		size = (size + alignment - 1) / alignment * alignment;
+		ptr = std::aligned_alloc(alignment, size);
+	}
+
+	if (ptr == nullptr)
+		throw std::bad_alloc {};
+
+	return ptr;
+}
+
+void log_timings(const Timings &timings)
+{
+	const f64 n = casts::to<f64>(timings.count);
+	const f64 mean = timings.total / n;
+	const f64 stddev = std::sqrt(timings.total_of_squares / n - mean * mean);
+
+	const f64 min = chrono::duration_cast<microseconds<f64>>(timings.min).count();
+	const f64 max = chrono::duration_cast<microseconds<f64>>(timings.max).count();
+
+	spdlog::info("Total: {:.0f}μs", timings.total);
+	spdlog::info("Mean: {:.2f}μs", mean);
+	spdlog::info("Standard Deviation: {:.2f}μs", stddev);
+	spdlog::info("Minimum: {:.3f}μs", min);
+	spdlog::info("Maximum: {:.3f}μs", max);
+}
+
 int run(const int argc, const char **argv)
 {
 	CLI::App app {"Utility for performance testing of iptsd"};
@@ -47,14 +136,8 @@ int run(const int argc, const char **argv)
 	const auto _sigterm = core::linux::signal<SIGTERM>([&](int) { perf.stop(); });
 	const auto _sigint = core::linux::signal<SIGINT>([&](int) { perf.stop(); });
 
-	using clock = std::chrono::steady_clock;
-
-	usize total = 0;
-	usize total_of_squares = 0;
-	usize count = 0;
-
-	clock::duration min = clock::duration::max();
-	clock::duration max = clock::duration::min();
+	Timings touch {};
+	Timings stylus {};
 
 	bool should_stop = false;
 
@@ -63,12 +146,8 @@ int run(const int argc, const char **argv)
 
 		Perf &papp = perf.application();
 
-		total += papp.total;
-		total_of_squares += papp.total_of_squares;
-		count += papp.count;
-
-		min = std::min(min, papp.min);
-		max = std::max(max, papp.max);
+		touch.add(papp.touch);
+		stylus.add(papp.stylus);
 
 		if (should_stop)
 			break;
@@ -76,16 +155,46 @@ int run(const int argc, const char **argv)
 		papp.reset();
 	}
 
-	const f64 n = casts::to<f64>(count);
-	const f64 mean = casts::to<f64>(total) / n;
-	const f64 stddev = std::sqrt(casts::to<f64>(total_of_squares) / n - mean * mean);
+	spdlog::info("Ran {} times", touch.count);
+	log_timings(touch);
 
-	spdlog::info("Ran {} times", count);
-	spdlog::info("Total: {}μs", total);
-	spdlog::info("Mean: {:.2f}μs", mean);
-	spdlog::info("Standard Deviation: {:.2f}μs", stddev);
-	spdlog::info("Minimum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(min).count());
-	spdlog::info("Maximum: {:.3f}μs", chrono::duration_cast<microseconds<f64>>(max).count());
+	if (stylus.count > 0) {
+		spdlog::info("Stylus: Ran {} times", stylus.count);
+		log_timings(stylus);
+	}
+
+	const usize windows = perf.application().dft_windows();
+
+	if (windows > 0) {
+		const Timings dft = perf.application().measure_dft(runs);
+		const f64 n = casts::to<f64>(dft.count * windows);
+
+		spdlog::info("DFT: Decoded {} windows {} times", windows, dft.count);
+		spdlog::info("DFT: Mean per window: {:.3f}μs", dft.total / n);
+	}
+
+	Perf &papp = perf.application();
+	usize allocations = 0;
+
+	if (papp.heatmaps() > 0) {
+		papp.warm_up_replay();
+		allocations = count_allocations([&] { papp.replay_heatmaps(); });
+
+		spdlog::info("Finder: Replayed {} heatmaps", papp.heatmaps());
+		spdlog::info("Finder: Allocations: {}", allocations);
+	}
+
+	spdlog::info("Buffer Growth: {}", perf.application().buffer_growth());
+	spdlog::info("Dropped Contacts: {}", perf.application().dropped_contacts());
+	spdlog::info("Idle Frames: {}", perf.application().idle_frames());
+	spdlog::info("Duplicate Frames: {}", perf.application().duplicate_frames());
+	spdlog::info("Unique Frames: {}", perf.application().unique_frames());
+	spdlog::info("Missed Frames: {}", perf.application().missed_frames());
+
+	if (allocations > 0) {
+		spdlog::error("The contact finder allocated memory after it was warmed up");
+		return EXIT_FAILURE;
+	}
 
 	if (!should_stop)
 		return EXIT_FAILURE;
@@ -96,6 +205,73 @@ int run(const int argc, const char **argv)
 } // namespace
 } // namespace iptsd::apps::perf
 
+/*
+ * Replace the global operator new, to count allocations made by the contact finder.
+ * The nothrow variants call these, so they don't have to be replaced as well.
+ */
+
+void *operator new(const std::size_t size)
+{
+	return iptsd::apps::perf::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new[](const std::size_t size)
+{
+	return iptsd::apps::perf::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void *operator new(const std::size_t size, const std::align_val_t alignment)
+{
+	return iptsd::apps::perf::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](const std::size_t size, const std::align_val_t alignment)
+{
+	return iptsd::apps::perf::allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::size_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::size_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::size_t /* unused */,
+		     const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::size_t /* unused */,
+		       const std::align_val_t /* unused */) noexcept
+{
+	std::free(ptr);
+}
+
 int main(const int argc, const char **argv)
 {
 	spdlog::set_pattern("[%X.%e] [%^%l%$] %v");
@@ -3,34 +3,159 @@
 #ifndef IPTSD_APPS_PERF_PERF_HPP
 #define IPTSD_APPS_PERF_PERF_HPP
 
+#include <common/casts.hpp>
 #include <common/chrono.hpp>
 #include <common/types.hpp>
 #include <contacts/finder.hpp>
 #include <core/generic/application.hpp>
 #include <core/generic/config.hpp>
+#include <core/generic/dft.hpp>
+#include <ipts/parser.hpp>
+#include <ipts/protocol/dft.hpp>
+#include <ipts/samples/dft.hpp>
+#include <ipts/samples/stylus.hpp>
+#include <ipts/samples/touch.hpp>
 
 #include <gsl/gsl>
 
 #include <algorithm>
+#include <optional>
 #include <utility>
 #include <vector>
 
 namespace iptsd::apps::perf {
 
-class Perf : public core::Application {
-private:
+/*
+ * How long it took to process one kind of report.
+ */
+struct Timings {
+public:
 	using clock = chrono::steady_clock;
 
-public:
-	usize total = 0;
-	usize total_of_squares = 0;
+	// The sum of all durations, in microseconds.
+	f64 total = 0;
+
+	// The sum of all squared durations, in microseconds.
+	f64 total_of_squares = 0;
+
 	usize count = 0;
 
 	clock::duration min = clock::duration::max();
 	clock::duration max = clock::duration::min();
 
+public:
+	/*!
+	 * Adds the duration of one report.
+	 *
+	 * @param[in] duration How long processing the report took.
+	 */
+	void add(const clock::duration duration)
+	{
+		// Stylus reports take less than a microsecond, so don't round to full microseconds.
+		const f64 x = chrono::duration_cast<microseconds<f64>>(duration).count();
+
+		total += x;
+		total_of_squares += x * x;
+
+		min = std::min(min, duration);
+		max = std::max(max, duration);
+
+		++count;
+	}
+
+	/*!
+	 * Adds the durations of other reports.
+	 *
+	 * @param[in] other The timings to add.
+	 */
+	void add(const Timings &other)
+	{
+		total += other.total;
+		total_of_squares += other.total_of_squares;
+		count += other.count;
+
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+	}
+};
+
+/*
+ * A copy of a DFT window, that doesn't depend on the buffer it was parsed from.
+ */
+struct DftRecording {
+public:
+	// The window, the rows are stored separately.
+	ipts::samples::DftWindow window {};
+
+	std::vector<ipts::protocol::dft::Row> x {};
+	std::vector<ipts::protocol::dft::Row> y {};
+};
+
+/*
+ * Records all DFT windows and heatmaps that are passed to the parser.
+ */
+struct Recorder : public ipts::IgnoreSamples {
+public:
+	std::vector<DftRecording> windows {};
+
+	// The heatmaps, normalized the same way as before contact detection.
+	std::vector<Image<f64>> heatmaps {};
+
+public:
+	void on_touch(const ipts::samples::Touch &data)
+	{
+		const Eigen::Index rows = casts::to_eigen(data.rows);
+		const Eigen::Index cols = casts::to_eigen(data.columns);
+
+		if (rows == 0 || cols == 0)
+			return;
+
+		const Eigen::Map<const Image<u8>> mapped {data.heatmap.data(), rows, cols};
+
+		const auto min = casts::to<f64>(data.min);
+		const auto max = casts::to<f64>(data.max);
+
+		heatmaps.emplace_back(1.0 - (mapped.cast<f64>() - min) / (max - min));
+	}
+
+	void on_dft(const ipts::samples::DftWindow &data)
+	{
+		DftRecording &recording = windows.emplace_back();
+
+		recording.window = data;
+		recording.window.x = {};
+		recording.window.y = {};
+
+		recording.x.assign(data.x.begin(), data.x.end());
+		recording.y.assign(data.y.begin(), data.y.end());
+	}
+};
+
+class Perf : public core::Application {
+private:
+	using clock = chrono::steady_clock;
+
+public:
+	// Reports that contained a heatmap.
+	Timings touch {};
+
+	// Reports that contained stylus data, but no heatmap.
+	Timings stylus {};
+
 private:
 	bool m_had_touch {};
+	bool m_had_stylus {};
+
+	// Collects the DFT windows and heatmaps of the data for benchmarking them on their own.
+	Recorder m_recorder {};
+	ipts::Parser<Recorder> m_recorder_parser {m_recorder};
+
+	// Whether the DFT windows and heatmaps still have to be recorded.
+	bool m_recording = true;
+
+	// A separate contact finder for replaying the recorded heatmaps.
+	std::optional<contacts::Finder<f64>> m_replay {};
+	std::vector<contacts::Contact<f64>> m_replay_contacts {};
 
 public:
 	Perf(const core::Config &config, const core::DeviceInfo &info)
@@ -41,6 +166,11 @@ public:
 		m_had_touch = true;
 	}
 
+	void on_stylus(const ipts::samples::Stylus & /* unused */) override
+	{
+		m_had_stylus = true;
+	}
+
 	void on_data(const gsl::span<u8> data) override
 	{
 		// Take start time
@@ -49,40 +179,131 @@ public:
 		// Send the report to the finder through the parser for processing
 		core::Application::on_data(data);
 
-		if (std::exchange(m_had_touch, false)) {
-			// Take end time
-			const clock::time_point end = clock::now();
-			const clock::duration x_ns = end - start;
+		// Take end time
+		const clock::time_point end = clock::now();
+
+		const bool had_touch = std::exchange(m_had_touch, false);
+		const bool had_stylus = std::exchange(m_had_stylus, false);
+
+		if (had_touch)
+			touch.add(end - start);
+		else if (had_stylus)
+			stylus.add(end - start);
+
+		if (m_recording)
+			m_recorder_parser.parse(data);
+	}
+
+	/*!
+	 * How many DFT windows were recorded from the data.
+	 *
+	 * @return The number of DFT windows in one pass over the data.
+	 */
+	[[nodiscard]] usize dft_windows() const
+	{
+		return m_recorder.windows.size();
+	}
+
+	/*!
+	 * Measures how long the DFT stylus takes for decoding the recorded DFT windows.
+	 *
+	 * Unlike the timings of the stylus reports, this doesn't include parsing the data
+	 * or processing the decoded stylus sample.
+	 *
+	 * @param[in] runs How many times all windows are decoded.
+	 * @return How long decoding all windows took, once for every run.
+	 */
+	[[nodiscard]] Timings measure_dft(const usize runs)
+	{
+		Timings timings {};
+		core::DftStylus dft {m_config, m_info};
 
-			// Divide early for x and x**2 because they are overflowing
-			const usize x_us = chrono::duration_cast<microseconds<usize>>(x_ns).count();
+		for (DftRecording &recording : m_recorder.windows) {
+			recording.window.x = recording.x;
+			recording.window.y = recording.y;
+		}
 
-			total += x_us;
-			total_of_squares += x_us * x_us;
+		for (usize i = 0; i < runs; i++) {
+			const clock::time_point start = clock::now();
 
-			min = std::min(min, x_ns);
-			max = std::max(max, x_ns);
+			for (const DftRecording &recording : m_recorder.windows)
+				dft.input(recording.window);
 
-			++count;
+			timings.add(clock::now() - start);
 		}
+
+		return timings;
+	}
+
+	/*!
+	 * How many heatmaps were recorded from the data.
+	 *
+	 * @return The number of heatmaps in one pass over the data.
+	 */
+	[[nodiscard]] usize heatmaps() const
+	{
+		return m_recorder.heatmaps.size();
+	}
+
+	/*!
+	 * Creates a new contact finder and passes all recorded heatmaps through it once.
+	 *
+	 * This grows the buffers of the finder to the size that the data requires,
+	 * so that @ref replay_heatmaps doesn't have to allocate any memory.
+	 */
+	void warm_up_replay()
+	{
+		m_replay.emplace(m_config.contacts());
+
+		this->replay_heatmaps();
+		m_replay->reset();
+	}
+
+	/*!
+	 * Passes all recorded heatmaps through the contact finder that was warmed up.
+	 */
+	void replay_heatmaps()
+	{
+		for (const Image<f64> &heatmap : m_recorder.heatmaps)
+			m_replay->find(heatmap, m_replay_contacts);
+	}
+
+	/*!
+	 * How many frames changed the size of the internal buffers of the contact finder.
+	 *
+	 * This is only a diagnostic for finding the buffer that grows,
+	 * use @ref replay_heatmaps for checking if the finder allocates memory.
+	 */
+	[[nodiscard]] usize buffer_growth() const
+	{
+		return m_finder.buffer_growth();
+	}
+
+	/*!
+	 * How many contacts were dropped because a frame contained more than the finder can store.
+	 */
+	[[nodiscard]] usize dropped_contacts() const
+	{
+		return m_finder.dropped_contacts();
 	}
 
 	/*!
-	 * Resets the contact finder.
+	 * Resets the contact finder and the timestamps.
 	 *
 	 * This has to be done after every iteration to prevent
-	 * skewing the results due to finger tracking being different.
+	 * skewing the results due to finger tracking being different,
+	 * and to not count the restart of the data as missed frames.
 	 */
 	void reset()
 	{
 		m_finder.reset();
+		this->reset_timing();
 
-		total = 0;
-		total_of_squares = 0;
-		count = 0;
+		// Every run sees the same windows, so they only need to be recorded once.
+		m_recording = false;
 
-		min = clock::duration::max();
-		max = clock::duration::min();
+		touch = Timings {};
+		stylus = Timings {};
 	}
 };
 
@@ -40,7 +40,11 @@ protected:
 
 public:
 	Visualize(const core::Config &config, const core::DeviceInfo &info)
-		: core::Application(config, info) {};
+		: core::Application(config, info)
+	{
+		// The heatmap is drawn for every frame, so it always has to be updated
+		m_skip_idle_frames = false;
+	};
 
 	void on_touch(const std::vector<contacts::Contact<f64>> & /* unused */) override
 	{
@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_FASTMATH_HPP
+#define IPTSD_COMMON_FASTMATH_HPP
+
+#include "casts.hpp"
+#include "types.hpp"
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace iptsd::common::fastmath {
+
+/*!
+ * Raises numbers to a fixed power, using lookup tables instead of std::pow.
+ *
+ * Every number is split into a mantissa in [0.5, 1) and a power of two. The power of the
+ * mantissa is interpolated from a table, the power of the exponent is looked up directly.
+ *
+ * The tables are checked against std::pow when they are built. If the exponent makes the
+ * interpolation too inaccurate, std::pow is used for all numbers instead.
+ */
+class Pow {
+public:
+	// How many intervals the table for the mantissa has.
+	static constexpr usize SIZE = 1024;
+
+	// The range of binary exponents that is covered by the tables.
+	static constexpr int MIN_EXP = -64;
+	static constexpr int MAX_EXP = 64;
+
+	// The largest relative error that is accepted, compared to std::pow.
+	static constexpr f64 TOLERANCE = 1e-6;
+
+private:
+	// The power that numbers are raised to.
+	f64 m_exponent;
+
+	// The power of the mantissa, sampled at SIZE + 1 points from 0.5 to 1.
+	std::array<f64, SIZE + 1> m_mantissa {};
+
+	// The power of every binary exponent between MIN_EXP and MAX_EXP.
+	std::array<f64, MAX_EXP - MIN_EXP + 1> m_scale {};
+
+	// Whether the tables are too inaccurate, and std::pow has to be used instead.
+	bool m_fallback = false;
+
+public:
+	/*!
+	 * Builds the tables for an exponent and checks their accuracy.
+	 *
+	 * @param[in] exponent The power that numbers are raised to.
+	 */
+	explicit Pow(const f64 exponent) : m_exponent {exponent}
+	{
+		for (usize i = 0; i <= SIZE; i++)
+			m_mantissa[i] = std::pow(Pow::mantissa(casts::to<f64>(i)), exponent);
+
+		for (int k = MIN_EXP; k <= MAX_EXP; k++)
+			m_scale[casts::to<usize>(k - MIN_EXP)] = std::pow(2.0, k * exponent);
+
+		m_fallback = !std::isfinite(exponent) || this->error() > TOLERANCE;
+	}
+
+	/*!
+	 * Raises a number to the power of the exponent.
+	 *
+	 * Numbers that are not positive, or outside of the range covered by the tables,
+	 * are passed to std::pow, so that all special cases behave the same.
+	 *
+	 * @param[in] x The number to raise.
+	 * @return x to the power of the exponent.
+	 */
+	[[nodiscard]] f64 operator()(const f64 x) const
+	{
+		if (m_fallback || !(x > 0))
+			return std::pow(x, m_exponent);
+
+		int k = 0;
+		const f64 m = std::frexp(x, &k);
+
+		if (k < MIN_EXP || k > MAX_EXP)
+			return std::pow(x, m_exponent);
+
+		return this->interpolate(m) * m_scale[casts::to<usize>(k - MIN_EXP)];
+	}
+
+	/*!
+	 * Whether std::pow is used, because the tables were not accurate enough.
+	 *
+	 * @return true if the tables are not used.
+	 */
+	[[nodiscard]] bool fallback() const
+	{
+		return m_fallback;
+	}
+
+	/*!
+	 * The largest relative error of the interpolated mantissa, compared to std::pow.
+	 *
+	 * The error of a linear interpolation is largest in the middle of an interval,
+	 * so only these points need to be checked.
+	 *
+	 * @return The largest relative error.
+	 */
+	[[nodiscard]] f64 error() const
+	{
+		f64 error = 0;
+
+		for (usize i = 0; i < SIZE; i++) {
+			const f64 m = Pow::mantissa(casts::to<f64>(i) + 0.5);
+			const f64 exact = std::pow(m, m_exponent);
+
+			error = std::max(error, std::abs(this->interpolate(m) - exact) / exact);
+		}
+
+		// NaN is not larger than anything, but has to fail the check.
+		return std::isnan(error) ? std::numeric_limits<f64>::infinity() : error;
+	}
+
+private:
+	/*!
+	 * The mantissa at a (fractional) position in the table.
+	 *
+	 * @param[in] pos The position in the table.
+	 * @return The mantissa at that position.
+	 */
+	[[nodiscard]] static f64 mantissa(const f64 pos)
+	{
+		return 0.5 + pos * 0.5 / SIZE;
+	}
+
+	/*!
+	 * Interpolates the power of a mantissa from the table.
+	 *
+	 * @param[in] m The mantissa, in [0.5, 1).
+	 * @return The mantissa raised to the power of the exponent.
+	 */
+	[[nodiscard]] f64 interpolate(const f64 m) const
+	{
+		const f64 pos = (m - 0.5) * 2 * SIZE;
+		const usize i = std::min(gsl::narrow_cast<usize>(pos), SIZE - 1);
+
+		const f64 t = pos - casts::to<f64>(i);
+		return m_mantissa[i] + (m_mantissa[i + 1] - m_mantissa[i]) * t;
+	}
+};
+
+/*!
+ * Calculates the arc tangent of y / x, using the signs of both to find the quadrant.
+ *
+ * Uses a polynomial approximation (Abramowitz and Stegun, 4.4.49) on [0, 1].
+ * The absolute error is below 1e-7 radians.
+ *
+ * @param[in] y The y coordinate.
+ * @param[in] x The x coordinate.
+ * @return The angle of the point (x, y), in [-pi, pi].
+ */
+inline f64 atan2(const f64 y, const f64 x)
+{
+	const f64 ax = std::abs(x);
+	const f64 ay = std::abs(y);
+
+	// Leave zeros, infinities and NaN to the special cases of libm.
+	if (!std::isfinite(ax) || !std::isfinite(ay) || (ax == 0 && ay == 0))
+		return std::atan2(y, x);
+
+	// Reduce the argument to [0, 1], where the polynomial is accurate.
+	const bool swap = ay > ax;
+	const f64 z = swap ? ax / ay : ay / ax;
+	const f64 z2 = z * z;
+
+	f64 a = 0.0028662257;
+	a = a * z2 - 0.0161657367;
+	a = a * z2 + 0.0429096138;
+	a = a * z2 - 0.0752896400;
+	a = a * z2 + 0.1065626393;
+	a = a * z2 - 0.1420889944;
+	a = a * z2 + 0.1999355085;
+	a = a * z2 - 0.3333314528;
+	a = (a * z2 + 1) * z;
+
+	if (swap)
+		a = M_PI_2 - a;
+
+	if (x < 0)
+		a = M_PI - a;
+
+	return std::copysign(a, y);
+}
+
+/*!
+ * Calculates the arc sine of a number.
+ *
+ * @param[in] x The sine of the angle, in [-1, 1].
+ * @return The angle, in [-pi/2, pi/2]. NaN if x is out of range.
+ */
+inline f64 asin(const f64 x)
+{
+	if (!(std::abs(x) <= 1))
+		return NAN;
+
+	return fastmath::atan2(x, std::sqrt((1 - x) * (1 + x)));
+}
+
+/*!
+ * Calculates the sine and the cosine of an angle.
+ *
+ * The angle is reduced to [-pi/4, pi/4], where the taylor series converge quickly.
+ * The absolute error is below 1e-10 for angles of a few turns, which is what the
+ * stylus sends. The error grows for very large angles.
+ *
+ * @param[in] x The angle, in radians.
+ * @param[out] sin The sine of the angle.
+ * @param[out] cos The cosine of the angle.
+ */
+inline void sincos(const f64 x, f64 &sin, f64 &cos)
+{
+	const f64 q = std::floor(x * M_2_PI + 0.5);
+	const f64 r = x - q * M_PI_2;
+	const f64 r2 = r * r;
+
+	f64 s = -1.0 / 39916800;
+	s = s * r2 + 1.0 / 362880;
+	s = s * r2 - 1.0 / 5040;
+	s = s * r2 + 1.0 / 120;
+	s = s * r2 - 1.0 / 6;
+	s = (s * r2 + 1) * r;
+
+	f64 c = 1.0 / 479001600;
+	c = c * r2 - 1.0 / 3628800;
+	c = c * r2 + 1.0 / 40320;
+	c = c * r2 - 1.0 / 720;
+	c = c * r2 + 1.0 / 24;
+	c = c * r2 - 1.0 / 2;
+	c = c * r2 + 1;
+
+	// The quadrant of the angle, in [0, 3].
+	const auto quadrant = gsl::narrow_cast<i64>(q) & 3;
+
+	switch (quadrant) {
+	case 0:
+		sin = s;
+		cos = c;
+		break;
+	case 1:
+		sin = c;
+		cos = -s;
+		break;
+	case 2:
+		sin = -s;
+		cos = -c;
+		break;
+	default:
+		sin = -c;
+		cos = s;
+		break;
+	}
+}
+
+} // namespace iptsd::common::fastmath
+
+#endif // IPTSD_COMMON_FASTMATH_HPP
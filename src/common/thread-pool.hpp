@@ -0,0 +1,363 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_COMMON_THREAD_POOL_HPP
+#define IPTSD_COMMON_THREAD_POOL_HPP
+
+#include "casts.hpp"
+#include "types.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::common {
+
+/*!
+ * A small pool of persistent worker threads for splitting work into independent items.
+ *
+ * The workers are pinned to a CPU each, chosen from the CPUs the process is allowed to run on.
+ * After finishing a batch of work they poll for the next one for a short time, before going to
+ * sleep until they are woken up again. This keeps the latency low while work arrives in quick
+ * succession, without burning CPU time when idle.
+ */
+class ThreadPool {
+private:
+	// How often a worker checks for new work before it goes to sleep.
+	static constexpr usize SPIN_COUNT = 1 << 14;
+
+	// The lower bits of m_next and m_count hold their value, the upper bits tag their batch.
+	static constexpr u64 INDEX_BITS = 32;
+	static constexpr u64 INDEX_MASK = (u64 {1} << INDEX_BITS) - 1;
+
+	// The worker threads.
+	std::vector<std::thread> m_threads {};
+
+	// Protects sleeping and waking up the workers.
+	std::mutex m_mutex {};
+
+	// Used for waking up sleeping workers.
+	std::condition_variable m_wakeup {};
+
+	// How many workers are currently sleeping.
+	usize m_sleeping = 0;
+
+	// Incremented whenever a new batch of work is available.
+	std::atomic<u64> m_generation = 0;
+
+	// Whether the workers should exit.
+	std::atomic_bool m_stop = false;
+
+	// The function that processes a single work item.
+	void (*m_function)(void *, usize) = nullptr;
+
+	// The context that is passed to m_function.
+	void *m_context = nullptr;
+
+	// The number of work items in the current batch, tagged with its batch.
+	std::atomic<u64> m_count = 0;
+
+	// The index of the next work item that has not been taken yet, tagged with its batch.
+	std::atomic<u64> m_next = 0;
+
+	// How many work items of the current batch are done.
+	std::atomic<u64> m_finished = 0;
+
+	// How many workers could not be pinned to a CPU.
+	usize m_unpinned = 0;
+
+public:
+	/*!
+	 * Starts the worker threads.
+	 *
+	 * The thread calling @ref run is participating in the work too, so a pool with
+	 * n worker threads processes up to n + 1 work items at the same time.
+	 *
+	 * If the process is only allowed to run on a single CPU, no workers are started, since
+	 * they would be spinning on the same CPU as the thread that is calling @ref run.
+	 *
+	 * @param[in] threads The number of worker threads.
+	 */
+	ThreadPool(const usize threads)
+	{
+		const std::vector<usize> cpus = ThreadPool::allowed_cpus();
+
+		if (cpus.size() == 1)
+			return;
+
+		m_threads.reserve(threads);
+
+		try {
+			for (usize i = 0; i < threads; ++i) {
+				m_threads.emplace_back([this] { this->worker(); });
+
+				if (cpus.empty()) {
+					m_unpinned++;
+					continue;
+				}
+
+				// The workers are pinned starting with the second allowed CPU. The
+				// first one only gets a worker if there are more workers than CPUs.
+				const usize cpu = cpus[(i + 1) % cpus.size()];
+
+				if (!ThreadPool::pin(m_threads.back(), cpu))
+					m_unpinned++;
+			}
+		} catch (...) {
+			// Threads that are still joinable when they are destroyed terminate the process.
+			this->stop();
+			throw;
+		}
+	}
+
+	~ThreadPool()
+	{
+		this->stop();
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	ThreadPool(ThreadPool &&) = delete;
+	ThreadPool &operator=(ThreadPool &&) = delete;
+
+	/*!
+	 * The number of worker threads.
+	 *
+	 * @return How many threads were started by the pool.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_threads.size();
+	}
+
+	/*!
+	 * The number of worker threads that could not be pinned to a CPU.
+	 *
+	 * These threads still work, but the scheduler is free to move them around.
+	 *
+	 * @return How many threads are not pinned.
+	 */
+	[[nodiscard]] usize unpinned() const
+	{
+		return m_unpinned;
+	}
+
+	/*!
+	 * Processes a batch of work items and waits until all of them are done.
+	 *
+	 * The function must not throw, and calls for different indices must not depend on
+	 * each other, since they are running in parallel.
+	 *
+	 * This returns as soon as every work item is done. Workers that wake up too late to
+	 * take any work items are not waited for.
+	 *
+	 * @param[in] count The number of work items.
+	 * @param[in] func Called once for every index in [0, count).
+	 */
+	template <class Func>
+	void run(const usize count, Func &&func)
+	{
+		using F = std::remove_reference_t<Func>;
+
+		// The index has to fit into the lower bits of m_next.
+		const u64 items = casts::to<u32>(count);
+
+		m_function = [](void *context, const usize index) {
+			(*static_cast<F *>(context))(index);
+		};
+
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+		m_context = const_cast<void *>(static_cast<const void *>(&func));
+
+		const u64 generation = m_generation.load(std::memory_order_relaxed) + 1;
+		const u64 tag = generation << INDEX_BITS;
+
+		m_count.store(tag | items, std::memory_order_relaxed);
+		m_finished.store(0, std::memory_order_relaxed);
+
+		// Publishes the batch, workers that see the new tag also see everything above.
+		m_next.store(tag, std::memory_order_release);
+
+		bool sleeping = false;
+
+		{
+			const std::lock_guard lock {m_mutex};
+
+			m_generation.store(generation, std::memory_order_release);
+			sleeping = m_sleeping > 0;
+		}
+
+		if (sleeping)
+			m_wakeup.notify_all();
+
+		this->process();
+
+		// Wait for the workers to finish the work items they took.
+		while (m_finished.load(std::memory_order_acquire) < items)
+			std::this_thread::yield();
+	}
+
+private:
+	/*!
+	 * Tells all workers to exit and waits until they did.
+	 */
+	void stop()
+	{
+		{
+			const std::lock_guard lock {m_mutex};
+			m_stop.store(true, std::memory_order_release);
+		}
+
+		m_wakeup.notify_all();
+
+		for (std::thread &thread : m_threads)
+			thread.join();
+	}
+
+	/*!
+	 * Takes work items from the current batch until none are left.
+	 *
+	 * A work item is only taken if the batch did not change in the meantime. Otherwise a
+	 * worker that is late to a batch could call the function of the previous batch with
+	 * an index of the next one, or take an index that is out of range for its batch.
+	 */
+	void process()
+	{
+		u64 next = m_next.load(std::memory_order_acquire);
+
+		while (true) {
+			const u64 count = m_count.load(std::memory_order_relaxed);
+
+			// The count already belongs to a newer batch than the index.
+			if ((count >> INDEX_BITS) != (next >> INDEX_BITS)) {
+				next = m_next.load(std::memory_order_acquire);
+				continue;
+			}
+
+			const u64 index = next & INDEX_MASK;
+
+			if (index >= (count & INDEX_MASK))
+				return;
+
+			if (!m_next.compare_exchange_weak(next,
+			                                  next + 1,
+			                                  std::memory_order_acquire,
+			                                  std::memory_order_acquire))
+				continue;
+
+			m_function(m_context, casts::to<usize>(index));
+			m_finished.fetch_add(1, std::memory_order_release);
+
+			next = m_next.load(std::memory_order_acquire);
+		}
+	}
+
+	/*!
+	 * The main loop of the worker threads.
+	 */
+	void worker()
+	{
+		u64 generation = 0;
+
+		// Whether a sleeping worker has to wake up.
+		const auto woken = [&] {
+			if (m_stop.load(std::memory_order_acquire))
+				return true;
+
+			return m_generation.load(std::memory_order_acquire) != generation;
+		};
+
+		while (true) {
+			usize spins = 0;
+
+			// Wait for new work, first by polling and then by sleeping.
+			while (m_generation.load(std::memory_order_acquire) == generation) {
+				if (m_stop.load(std::memory_order_acquire))
+					return;
+
+				if (spins++ < SPIN_COUNT) {
+					ThreadPool::relax();
+					continue;
+				}
+
+				std::unique_lock lock {m_mutex};
+				m_sleeping++;
+
+				m_wakeup.wait(lock, woken);
+
+				m_sleeping--;
+			}
+
+			generation = m_generation.load(std::memory_order_acquire);
+			this->process();
+		}
+	}
+
+	/*!
+	 * Tells the CPU that the thread is waiting in a spin loop.
+	 *
+	 * This saves power, and leaves the execution units of the core to its other hyperthread.
+	 */
+	static void relax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	/*!
+	 * The CPUs that the process is allowed to run on.
+	 *
+	 * @return The indices of the CPUs, empty if they could not be determined.
+	 */
+	static std::vector<usize> allowed_cpus()
+	{
+		cpu_set_t set {};
+		std::vector<usize> cpus {};
+
+		CPU_ZERO(&set);
+
+		if (sched_getaffinity(0, sizeof(set), &set) != 0)
+			return cpus;
+
+		for (usize cpu = 0; cpu < casts::to_unsigned(CPU_SETSIZE); cpu++) {
+			if (CPU_ISSET(cpu, &set))
+				cpus.push_back(cpu);
+		}
+
+		return cpus;
+	}
+
+	/*!
+	 * Pins a thread to a CPU.
+	 *
+	 * This is only a hint, if it fails the thread keeps running wherever the scheduler
+	 * wants it to.
+	 *
+	 * @param[in] thread The thread to pin.
+	 * @param[in] cpu The index of the CPU.
+	 * @return Whether the thread was pinned.
+	 */
+	static bool pin(std::thread &thread, const usize cpu)
+	{
+		cpu_set_t set {};
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+	}
+};
+
+} // namespace iptsd::common
+
+#endif // IPTSD_COMMON_THREAD_POOL_HPP
@@ -4,7 +4,9 @@
 #define IPTSD_CONTACTS_CONFIG_HPP
 
 #include "detection/config.hpp"
+#include "prediction/config.hpp"
 #include "stability/config.hpp"
+#include "tracking/config.hpp"
 #include "validation/config.hpp"
 
 #include <common/types.hpp>
@@ -20,11 +22,20 @@ public:
 	// The configuration options for the detection phase.
 	detection::Config<T> detection {};
 
+	// The configuration options for the tracking phase.
+	tracking::Config<T> tracking {};
+
+	// The configuration options for the prediction phase.
+	prediction::Config<T> prediction {};
+
 	// The configuration options for the validation phase.
 	validation::Config<T> validation {};
 
 	// The configuration options for the stabilization phase.
 	stability::Config<T> stability {};
+
+	// How many frames are kept in the history that is shared by all stages.
+	usize history = 2;
 };
 
 } // namespace iptsd::contacts
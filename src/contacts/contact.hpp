@@ -7,7 +7,6 @@
 #include <common/types.hpp>
 
 #include <optional>
-#include <vector>
 
 namespace iptsd::contacts {
 
@@ -57,20 +56,6 @@ public:
 	 * Whether the contact is stable.
 	 */
 	std::optional<bool> stable = std::nullopt;
-
-public:
-	static std::optional<Contact<T>> find_in_frame(const usize index,
-	                                               const std::vector<Contact<T>> &frame)
-	{
-		for (const Contact<T> &contact : frame) {
-			if (contact.index != index)
-				continue;
-
-			return contact;
-		}
-
-		return std::nullopt;
-	}
 };
 
 } // namespace iptsd::contacts
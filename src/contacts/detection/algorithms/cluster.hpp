@@ -117,13 +117,15 @@ void span_recursive(const RecursionState<Derived> state,
  * @param[in] position The starting position of the cluster (e.g. the local maxima).
  * @param[in] activation_threshold The activation threshold for searching.
  * @param[in] deactivation_threshold The deactivation threshold for searching.
+ * @param[in] visited Temporary storage for marking visited pixels.
  * @return The bounding box of the spanned cluster.
  */
 template <class Derived>
 Box span(const DenseBase<Derived> &heatmap,
          const Point &position,
          const typename DenseBase<Derived>::Scalar activation_threshold,
-         const typename DenseBase<Derived>::Scalar deactivation_threshold)
+         const typename DenseBase<Derived>::Scalar deactivation_threshold,
+         Image<bool> &visited)
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
@@ -142,7 +144,9 @@ Box span(const DenseBase<Derived> &heatmap,
 	if (y < 0 || y >= rows)
 		return cluster;
 
-	Image<bool> visited {rows, cols};
+	if (visited.rows() != rows || visited.cols() != cols)
+		visited.conservativeResize(rows, cols);
+
 	visited.setConstant(false);
 
 	const impl::RecursionState<Derived> state {
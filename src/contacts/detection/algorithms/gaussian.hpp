@@ -10,6 +10,7 @@
 #include <gsl/util>
 
 #include <type_traits>
+#include <vector>
 
 namespace iptsd::contacts::detection::gaussian {
 
@@ -30,8 +31,25 @@ struct Parameters {
 	// local bounds for sampling
 	Box bounds;
 
-	// local weights for sampling
-	Matrix<T> weights;
+	// local weights for sampling, the storage is owned by the caller
+	gsl::span<T> weights {};
+
+	// Whether the parameters stopped changing between two iterations.
+	bool converged = false;
+
+	/*!
+	 * The local weights as a matrix with the size of the bounds.
+	 *
+	 * The map is created on demand instead of being stored, because assigning
+	 * a map copies the data into the storage of the target, instead of rebinding it.
+	 *
+	 * @return A writable view of the weights.
+	 */
+	[[nodiscard]] Eigen::Map<Matrix<T>> weight_map() const
+	{
+		const Point size = bounds.sizes() + Point::Ones();
+		return Eigen::Map<Matrix<T>> {weights.data(), size.y(), size.x()};
+	}
 };
 
 namespace impl {
@@ -39,28 +57,12 @@ namespace impl {
 template <class T>
 constexpr T EPS = std::is_same_v<T, f32> ? gsl::narrow_cast<T>(1E-20) : gsl::narrow_cast<T>(1E-40);
 
-/*!
- * 2D Gaussian probability density function without normalization.
- *
- * @param[in] x Position at which to evaluate the function.
- * @param[in] mean Mean of the Gaussian.
- * @param[in] prec Precision matrix, i.e. the invariance of the covariance matrix.
- */
-template <class T>
-T gaussian_like(const Vector2<T> &x, const Vector2<T> &mean, const Matrix2<T> &prec)
-{
-	const Vector2<T> vec = x - mean;
-	const T vtmv = vec.transpose() * prec * vec;
-
-	return std::exp(-vtmv) / casts::to<T>(2);
-}
-
-template <class T, class DerivedData>
+template <class T, class DerivedData, class DerivedWeights>
 void assemble_system(Matrix6<T> &m,
                      Vector6<T> &rhs,
                      const Box &b,
                      const DenseBase<DerivedData> &data,
-                     const Matrix<T> &w)
+                     const DenseBase<DerivedWeights> &w)
 {
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
@@ -159,6 +161,16 @@ bool extract_params(const Vector6<T> &chi, T &scale, Vector2<T> &mean, Matrix2<T
 	return true;
 }
 
+/*!
+ * Evaluates the gaussians of all valid parameters and normalizes them into weight maps.
+ *
+ * The weights of every cluster are evaluated one row at a time, so that the exponential
+ * function can be vectorized. The sum of all gaussians is accumulated in the same pass,
+ * and only inside of the union of all cluster bounds, instead of the whole heatmap.
+ *
+ * @param[in,out] params The parameters whose weight maps will be updated.
+ * @param[out] total Temporary storage for the sum of all weights. Must have the heatmap size.
+ */
 template <class Derived>
 void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
                         DenseBase<Derived> &total)
@@ -173,9 +185,22 @@ void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scal
 		casts::to<T>(2) / casts::to<T>(rows),
 	};
 
-	total.setZero();
+	Box bounds {};
+	bounds.setEmpty();
+
+	for (const auto &p : params) {
+		if (p.valid)
+			bounds.extend(p.bounds);
+	}
+
+	if (bounds.isEmpty())
+		return;
+
+	// Only clear the area that will be accumulated into
+	const Point size = bounds.sizes() + Point::Ones();
+	total.derived().block(bounds.min().y(), bounds.min().x(), size.y(), size.x()).setZero();
 
-	// compute individual Gaussians in sample windows
+	// compute individual Gaussians in sample windows and sum them up
 	for (auto &p : params) {
 		if (!p.valid)
 			continue;
@@ -183,29 +208,33 @@ void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scal
 		const Point bmin = p.bounds.min();
 		const Point bmax = p.bounds.max();
 
-		for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
-			const T y = casts::to<T>(iy) * scale.y() - 1;
+		const Eigen::Index width = bmax.x() - bmin.x() + 1;
 
-			for (Eigen::Index ix = bmin.x(); ix <= bmax.x(); ix++) {
-				const T x = casts::to<T>(ix) * scale.x() - 1;
+		/*
+		 * Expand the quadratic form (v^T * prec * v) for v = (dx, dy), so that it can be
+		 * evaluated for a whole row of pixels at once.
+		 */
+		const T a = p.prec(0, 0);
+		const T b = p.prec(0, 1) + p.prec(1, 0);
+		const T c = p.prec(1, 1);
 
-				const T v = p.scale * gaussian_like({x, y}, p.mean, p.prec);
-				p.weights(iy - bmin.y(), ix - bmin.x()) = v;
-			}
-		}
-	}
+		const T alpha = p.scale / casts::to<T>(2);
 
-	// sum up total
-	for (auto &p : params) {
-		if (!p.valid)
-			continue;
+		// The x coordinates of the window, relative to the mean
+		const T x0 = casts::to<T>(bmin.x());
+		const T x1 = casts::to<T>(bmax.x());
 
-		const Point bmin = p.bounds.min();
-		const Point bmax = p.bounds.max();
+		const auto dx = Array<T>::LinSpaced(width, x0, x1) * scale.x() - (1 + p.mean.x());
 
-		for (Eigen::Index y = bmin.y(); y <= bmax.y(); y++) {
-			for (Eigen::Index x = bmin.x(); x <= bmax.x(); x++)
-				total(y, x) += p.weights(y - bmin.y(), x - bmin.x());
+		Eigen::Map<Matrix<T>> map = p.weight_map();
+
+		for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
+			const T dy = casts::to<T>(iy) * scale.y() - 1 - p.mean.y();
+
+			auto weights = map.row(iy - bmin.y()).array();
+
+			weights = (-(dx.square() * a + dx * (b * dy) + (c * dy * dy))).exp() * alpha;
+			total.derived().row(iy).segment(bmin.x(), width) += weights;
 		}
 	}
 
@@ -217,17 +246,45 @@ void update_weight_maps(std::vector<Parameters<typename DenseBase<Derived>::Scal
 		const Point bmin = p.bounds.min();
 		const Point bmax = p.bounds.max();
 
-		for (Eigen::Index y = bmin.y(); y <= bmax.y(); y++) {
-			for (Eigen::Index x = bmin.x(); x <= bmax.x(); x++) {
-				const T t = total(y, x);
+		const Eigen::Index width = bmax.x() - bmin.x() + 1;
 
-				if (t > casts::to<T>(0))
-					p.weights(y - bmin.y(), x - bmin.x()) /= t;
-			}
+		Eigen::Map<Matrix<T>> map = p.weight_map();
+
+		for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
+			const auto t = total.derived().row(iy).segment(bmin.x(), width);
+			auto weights = map.row(iy - bmin.y()).array();
+
+			weights = (t > casts::to<T>(0)).select(weights / t, weights);
 		}
 	}
 }
 
+/*!
+ * Checks if the fitting of a gaussian has converged.
+ *
+ * @param[in] p The parameters after the current iteration.
+ * @param[in] mean The mean before the current iteration.
+ * @param[in] prec The precision matrix before the current iteration.
+ * @param[in] scale The factor that was used to scale pixel coordinates.
+ * @param[in] tolerance How much the mean (in pixels) and the precision matrix (relative to
+ *                      its norm) can change while still being considered as converged.
+ * @return Whether the parameters have stopped changing.
+ */
+template <class T>
+bool converged(const Parameters<T> &p,
+               const Vector2<T> &mean,
+               const Matrix2<T> &prec,
+               const Vector2<T> &scale,
+               const T tolerance)
+{
+	const Vector2<T> delta = (p.mean - mean).cwiseQuotient(scale);
+
+	if (delta.cwiseAbs().maxCoeff() > tolerance)
+		return false;
+
+	return (p.prec - prec).norm() <= tolerance * p.prec.norm();
+}
+
 /**
  * ge_solve() - Solve a system of linear equations via Gaussian elimination.
  * @a: The system matrix A.
@@ -313,13 +370,84 @@ bool ge_solve(Matrix6<T> a, Vector6<T> b, Vector6<T> &x)
 	return true;
 }
 
+/*!
+ * Runs one iteration of fitting a gaussian onto a single cluster.
+ *
+ * This only depends on the parameters of the cluster and the weight map that belongs to it,
+ * so different clusters can be fitted at the same time.
+ *
+ * @param[in,out] p The parameters of the cluster.
+ * @param[in] data The heatmap that is being fitted.
+ * @param[in] scale The factor that was used for down-scaling the parameters.
+ * @param[in] tolerance The tolerance for detecting convergence.
+ */
+template <class T, class DerivedData>
+void fit_single(Parameters<T> &p,
+                const DenseBase<DerivedData> &data,
+                const Vector2<T> &scale,
+                const T tolerance)
+{
+	Matrix6<T> sys {};
+	Vector6<T> rhs {};
+	Vector6<T> chi {};
+
+	if (!p.valid || p.converged)
+		return;
+
+	const Vector2<T> mean = p.mean;
+	const Matrix2<T> prec = p.prec;
+
+	// assemble system of linear equations
+	assemble_system(sys, rhs, p.bounds, data, p.weight_map());
+
+	// solve systems
+	p.valid = ge_solve(sys, rhs, chi);
+	if (!p.valid)
+		return;
+
+	// get parameters
+	p.valid = extract_params(chi, p.scale, p.mean, p.prec);
+	if (!p.valid)
+		return;
+
+	p.converged = converged(p, mean, prec, scale, tolerance);
+}
+
+/*!
+ * Runs the fitting of all clusters on the calling thread.
+ */
+struct Serial {
+	template <class Func>
+	void operator()(const usize count, Func &&func) const
+	{
+		for (usize i = 0; i < count; ++i)
+			func(i);
+	}
+};
+
 } // namespace impl
 
-template <class Derived, class DerivedData>
+/*!
+ * Fits a gaussian onto every cluster of a heatmap.
+ *
+ * Fitting of a single cluster stops once its parameters have converged, and all fitting
+ * stops once every cluster has converged, or the maximum number of iterations was reached.
+ *
+ * @param[in,out] params The initial guesses for every cluster, and the fitted result.
+ * @param[in] data The heatmap that is being fitted.
+ * @param[in] tmp Temporary storage for weight map calculations.
+ * @param[in] iterations The maximum number of iterations.
+ * @param[in] tolerance The tolerance for detecting convergence, see @ref impl::converged.
+ * @param[in] run Called with the number of clusters and a function that fits the cluster
+ *                with the given index. Can be used to fit the clusters in parallel.
+ */
+template <class Derived, class DerivedData, class Executor = impl::Serial>
 void fit(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
          const DenseBase<DerivedData> &data,
          DenseBase<Derived> &tmp,
-         const usize iterations)
+         const usize iterations,
+         const typename DenseBase<Derived>::Scalar tolerance,
+         Executor &&run = Executor {})
 {
 	using T = typename DenseBase<Derived>::Scalar;
 
@@ -333,6 +461,8 @@ void fit(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
 
 	// down-scaling
 	for (auto &p : params) {
+		p.converged = false;
+
 		if (!p.valid)
 			continue;
 
@@ -352,25 +482,17 @@ void fit(std::vector<Parameters<typename DenseBase<Derived>::Scalar>> &params,
 		impl::update_weight_maps(params, tmp);
 
 		// fit individual parameters
-		for (auto &p : params) {
-			Matrix6<T> sys {};
-			Vector6<T> rhs {};
-			Vector6<T> chi {};
+		run(params.size(), [&](const usize index) {
+			impl::fit_single(params[index], data, scale, tolerance);
+		});
 
-			if (!p.valid)
-				continue;
+		bool converged = true;
 
-			// assemble system of linear equations
-			impl::assemble_system(sys, rhs, p.bounds, data, p.weights);
+		for (const auto &p : params)
+			converged &= !p.valid || p.converged;
 
-			// solve systems
-			p.valid = impl::ge_solve(sys, rhs, chi);
-			if (!p.valid)
-				continue;
-
-			// get parameters
-			p.valid = impl::extract_params(chi, p.scale, p.mean, p.prec);
-		}
+		if (converged)
+			break;
 	}
 
 	// undo down-scaling
@@ -10,15 +10,21 @@
 namespace iptsd::contacts::detection::maximas {
 
 /*!
- * Searches for all local maxima in the given data.
+ * Searches for local maxima inside of a region of the given data.
+ *
+ * Points at the border of the region are still compared against their neighbours outside
+ * of the region, so the result is the same as searching the whole data and discarding
+ * everything outside of the region. The found points are added to the existing ones.
  *
  * @param[in] data The data to process.
  * @param[in] threshold Only return local maxima whose value is above this threshold.
- * @param[out] maximas A reference to the vector where the found points will be stored.
+ * @param[in] region The region of the data that will be searched.
+ * @param[in,out] maximas A reference to the vector where the found points will be added.
  */
 template <class Derived>
 void find(const DenseBase<Derived> &data,
           typename DenseBase<Derived>::Scalar threshold,
+          const Box &region,
           std::vector<Point> &maximas)
 {
 	using T = typename DenseBase<Derived>::Scalar;
@@ -38,13 +44,11 @@ void find(const DenseBase<Derived> &data,
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
 
-	maximas.clear();
-
-	for (Eigen::Index y = 0; y < rows; y++) {
+	for (Eigen::Index y = region.min().y(); y <= region.max().y(); y++) {
 		const bool can_up = y > 0;
 		const bool can_down = y < rows - 1;
 
-		for (Eigen::Index x = 0; x < cols; x++) {
+		for (Eigen::Index x = region.min().x(); x <= region.max().x(); x++) {
 			const T value = data(y, x);
 
 			if (value <= threshold)
@@ -87,6 +91,24 @@ void find(const DenseBase<Derived> &data,
 	}
 }
 
+/*!
+ * Searches for all local maxima in the given data.
+ *
+ * @param[in] data The data to process.
+ * @param[in] threshold Only return local maxima whose value is above this threshold.
+ * @param[out] maximas A reference to the vector where the found points will be stored.
+ */
+template <class Derived>
+void find(const DenseBase<Derived> &data,
+          typename DenseBase<Derived>::Scalar threshold,
+          std::vector<Point> &maximas)
+{
+	const Box region {Point::Zero(), Point {data.cols() - 1, data.rows() - 1}};
+
+	maximas.clear();
+	find(data, threshold, region, maximas);
+}
+
 } // namespace iptsd::contacts::detection::maximas
 
 #endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_MAXIMAS_HPP
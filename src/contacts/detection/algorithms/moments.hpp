@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_MOMENTS_HPP
+#define IPTSD_CONTACTS_DETECTION_ALGORITHMS_MOMENTS_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <gsl/gsl>
+
+#include <cmath>
+
+namespace iptsd::contacts::detection::moments {
+
+/*!
+ * Estimates the shape of a cluster from the moments of its values.
+ *
+ * The mean is the weighted centroid of the cluster, and the covariance matrix is made up of
+ * the second central moments. For a cluster that contains a single gaussian, this is an
+ * approximation of the parameters that gaussian fitting would find, in a single pass.
+ *
+ * @param[in] data The heatmap that contains the cluster.
+ * @param[in] bounds The bounds of the cluster.
+ * @param[out] mean The weighted centroid of the cluster.
+ * @param[out] cov The covariance matrix of the cluster.
+ * @param[out] scale The estimated peak value of a gaussian with the same parameters.
+ * @return Whether the cluster has any weight and a non-degenerated shape.
+ */
+template <class T, class Derived>
+bool estimate(const DenseBase<Derived> &data,
+              const Box &bounds,
+              Vector2<T> &mean,
+              Matrix2<T> &cov,
+              T &scale)
+{
+	const Point &bmin = bounds.min();
+	const Point &bmax = bounds.max();
+
+	T sum = casts::to<T>(0);
+	Vector2<T> first = Vector2<T>::Zero();
+	Vector3<T> second = Vector3<T>::Zero();
+
+	/*
+	 * The coordinates are relative to the bounds of the cluster. This keeps them small,
+	 * so that subtracting the squared mean later on does not lose too much precision.
+	 */
+	for (Eigen::Index iy = bmin.y(); iy <= bmax.y(); iy++) {
+		const T y = casts::to<T>(iy - bmin.y());
+
+		for (Eigen::Index ix = bmin.x(); ix <= bmax.x(); ix++) {
+			const T x = casts::to<T>(ix - bmin.x());
+			const T v = gsl::narrow_cast<T>(data(iy, ix));
+
+			sum += v;
+
+			first.x() += v * x;
+			first.y() += v * y;
+
+			second.x() += v * x * x;
+			second.y() += v * x * y;
+			second.z() += v * y * y;
+		}
+	}
+
+	if (sum <= 0)
+		return false;
+
+	first /= sum;
+	second /= sum;
+
+	cov(0, 0) = second.x() - first.x() * first.x();
+	cov(0, 1) = second.y() - first.x() * first.y();
+	cov(1, 0) = cov(0, 1);
+	cov(1, 1) = second.z() - first.y() * first.y();
+
+	const T det = cov.determinant();
+
+	if (cov(0, 0) <= 0 || det <= 0)
+		return false;
+
+	mean = first + bmin.cast<T>();
+
+	// The integral of a gaussian is its peak value times 2 * pi * sqrt(det(cov))
+	scale = sum / (gsl::narrow_cast<T>(2 * M_PI) * std::sqrt(det));
+
+	return true;
+}
+
+} // namespace iptsd::contacts::detection::moments
+
+#endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_MOMENTS_HPP
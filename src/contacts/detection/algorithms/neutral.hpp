@@ -5,15 +5,35 @@
 
 #include "errors.hpp"
 
+#include <common/casts.hpp>
 #include <common/error.hpp>
 #include <common/types.hpp>
 
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
 namespace iptsd::contacts::detection::neutral {
 
 namespace impl {
 
+/*
+ * How many distinct levels a heatmap can have. IPTS sends heatmaps with 8 bits per pixel.
+ */
+constexpr usize LEVELS = 256;
+
 /*!
- * Calculates the statistical mode of a data set.
+ * Calculates the statistical mode of a heatmap.
+ *
+ * The heatmap is expected to consist of 8-bit levels. The range between the smallest and the
+ * largest value is split into one bin per level, which allows counting the values with a
+ * fixed histogram. Values that are not finite are ignored.
+ *
+ * If multiple values occur equally often, the one that reached that count first
+ * (in row-major order) is returned.
  *
  * @param[in] data: The input data set.
  * @return The statistical mode of all values in the data set.
@@ -26,7 +46,38 @@ typename DenseBase<Derived>::Scalar statistical_mode(const DenseBase<Derived> &d
 	const Eigen::Index cols = data.cols();
 	const Eigen::Index rows = data.rows();
 
-	std::map<T, u32> counts {};
+	T z_min = std::numeric_limits<T>::infinity();
+	T z_max = -std::numeric_limits<T>::infinity();
+
+	for (Eigen::Index y = 0; y < rows; y++) {
+		for (Eigen::Index x = 0; x < cols; x++) {
+			const T value = data(y, x);
+
+			if (!std::isfinite(value))
+				continue;
+
+			z_min = std::min(z_min, value);
+			z_max = std::max(z_max, value);
+		}
+	}
+
+	// No finite values
+	if (z_min > z_max)
+		return T {};
+
+	// All finite values are the same, the scale below would divide by zero.
+	if (z_min == z_max)
+		return z_min;
+
+	const T zero = casts::to<T>(0);
+	const T top = casts::to<T>(LEVELS - 1);
+	const T scale = top / (z_max - z_min);
+
+	// The range is too small to be split into levels.
+	if (!std::isfinite(scale))
+		return z_min;
+
+	std::array<u32, LEVELS> counts {};
 
 	u32 max_count = 0;
 	T max_element {};
@@ -34,7 +85,12 @@ typename DenseBase<Derived>::Scalar statistical_mode(const DenseBase<Derived> &d
 	for (Eigen::Index y = 0; y < rows; y++) {
 		for (Eigen::Index x = 0; x < cols; x++) {
 			const T value = data(y, x);
-			const u32 count = ++counts[value];
+
+			if (!std::isfinite(value))
+				continue;
+
+			const T level = std::clamp((value - z_min) * scale + casts::to<T>(0.5), zero, top);
+			const u32 count = ++counts[gsl::narrow_cast<usize>(level)];
 
 			if (count > max_count) {
 				max_count = count;
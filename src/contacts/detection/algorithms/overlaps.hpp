@@ -11,6 +11,8 @@
 
 #include <gsl/gsl>
 
+#include <algorithm>
+#include <numeric>
 #include <vector>
 
 namespace iptsd::contacts::detection::overlaps {
@@ -66,41 +68,134 @@ inline f64 overlap(const Box &a, const Box &b)
 	return iou;
 }
 
+} // namespace impl
+
+/*!
+ * Temporary storage for merging clusters.
+ */
+struct Buffers {
+	// The representative of every cluster in the union-find structure.
+	std::vector<usize> parents {};
+
+	// The end of every grid cell in the list of entries.
+	std::vector<usize> cells {};
+
+	// The indices of the clusters that are touching a grid cell, sorted by cell.
+	std::vector<usize> entries {};
+};
+
+namespace impl {
+
+// The size of the cells of the grid that is used for finding neighbouring clusters.
+constexpr Eigen::Index GRID_CELL_SIZE = 8;
+
 /*!
- * Searches for overlaps in a list of clusters.
+ * Finds the representative of a cluster in the union-find structure.
  *
- * @param[in] clusters The list of clusters to check for overlaps.
- * @param[out] overlaps A reference to the vector where overlapping pairs are stored.
- * @return Whether any overlaps have been found.
+ * @param[in,out] parents The union-find structure. Paths are compressed while searching.
+ * @param[in] index The index of the cluster.
+ * @return The index of the cluster that represents the set that contains the cluster.
  */
-inline bool search(const std::vector<Box> &clusters, std::vector<Vector2<usize>> &overlaps)
+inline usize find(std::vector<usize> &parents, usize index)
+{
+	while (parents[index] != index) {
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+
+	return index;
+}
+
+/*!
+ * Calls a function for every pair of clusters that intersect each other.
+ *
+ * Instead of testing all pairs, the clusters are sorted into a coarse grid, and only
+ * clusters that share a grid cell are tested. Every pair is only visited in the cell
+ * that contains the top left corner of the intersection, so it is visited exactly once.
+ *
+ * @param[in] clusters The list of clusters.
+ * @param[in] buffers Temporary storage for the grid.
+ * @param[in] func Called with the indices of both clusters (ordered) and their intersection.
+ */
+template <class Func>
+void intersections(const std::vector<Box> &clusters, Buffers &buffers, Func &&func)
 {
-	bool found_overlap = false;
 	const usize size = clusters.size();
 
-	overlaps.clear();
+	Box bounds {};
+	bounds.setEmpty();
 
-	for (usize i = 0; i < size; i++) {
-		const Box &a = clusters[i];
+	for (const Box &cluster : clusters)
+		bounds.extend(cluster);
 
-		// We only need to check all clusters, only the ones that weren't checked yet.
-		for (usize j = i + 1; j < size; j++) {
-			const Box &b = clusters[j];
+	if (bounds.isEmpty())
+		return;
 
-			// Ignore clusters that overlap by less than 50%
-			if (overlap(a, b) < 0.5)
-				continue;
+	const Point origin = bounds.min();
+	const Point grid = bounds.sizes() / GRID_CELL_SIZE + Point::Ones();
+
+	const auto cell = [&](const Point &point) {
+		const Point index = (point - origin) / GRID_CELL_SIZE;
+		return casts::to_unsigned(index.y() * grid.x() + index.x());
+	};
+
+	std::vector<usize> &cells = buffers.cells;
+	std::vector<usize> &entries = buffers.entries;
 
-			found_overlap = true;
+	cells.assign(casts::to_unsigned(grid.prod()) + 1, 0);
 
-			// Because of how this look is structured, j will always be larger than i.
-			// This means that if we iterate over the clusters the same way, by the
-			// time we have reached j, i has already been merged and j can be dropped.
-			overlaps.emplace_back(i, j);
+	// Count how many clusters touch every cell
+	for (const Box &cluster : clusters) {
+		const Point min = (cluster.min() - origin) / GRID_CELL_SIZE;
+		const Point max = (cluster.max() - origin) / GRID_CELL_SIZE;
+
+		for (Eigen::Index y = min.y(); y <= max.y(); y++) {
+			for (Eigen::Index x = min.x(); x <= max.x(); x++)
+				cells[casts::to_unsigned(y * grid.x() + x) + 1]++;
 		}
 	}
 
-	return found_overlap;
+	// Turn the counts into the start of every cell
+	for (usize i = 1; i < cells.size(); i++)
+		cells[i] += cells[i - 1];
+
+	entries.resize(cells.back());
+
+	// Sort the clusters into the cells. Afterwards, cells[i] points to the end of cell i.
+	for (usize i = 0; i < size; i++) {
+		const Box &cluster = clusters[i];
+
+		const Point min = (cluster.min() - origin) / GRID_CELL_SIZE;
+		const Point max = (cluster.max() - origin) / GRID_CELL_SIZE;
+
+		for (Eigen::Index y = min.y(); y <= max.y(); y++) {
+			for (Eigen::Index x = min.x(); x <= max.x(); x++)
+				entries[cells[casts::to_unsigned(y * grid.x() + x)]++] = i;
+		}
+	}
+
+	usize begin = 0;
+
+	for (usize c = 0; c + 1 < cells.size(); c++) {
+		const usize end = cells[c];
+
+		// Because the clusters were sorted into the cells in order, a is always smaller than b
+		for (usize i = begin; i < end; i++) {
+			for (usize j = i + 1; j < end; j++) {
+				const usize a = entries[i];
+				const usize b = entries[j];
+
+				const Box intersection = clusters[a].intersection(clusters[b]);
+
+				if (intersection.isEmpty() || cell(intersection.min()) != c)
+					continue;
+
+				func(a, b, intersection);
+			}
+		}
+
+		begin = end;
+	}
 }
 
 } // namespace impl
@@ -108,61 +203,92 @@ inline bool search(const std::vector<Box> &clusters, std::vector<Vector2<usize>>
 /*!
  * Merges overlapping clusters.
  *
- * The function will iterate over the list of clusters multiple times,
- * and search for ones that overlap by more than 50%. If overlaps were found,
- * one of the overlapping clusters will be extended, and the other one will be
- * dropped. If no overlaps were found in one iteration, the function returns.
+ * The function searches for clusters that overlap by more than 50%, and merges them.
+ * Overlaps are merged transitively, so if A overlaps with B and B overlaps with C, all three
+ * clusters are merged into one. Because a merged cluster is larger than its parts, it
+ * can overlap with other clusters again, so the search is repeated until no new overlaps
+ * are found.
+ *
+ * Afterwards, every cluster that was created by merging, or that still intersects
+ * another cluster, is flagged as overlapping. These clusters are likely to contain
+ * more than one contact.
  *
  * @param[in,out] clusters The list of clusters to check for overlaps.
- * @param[in] temp A temporary buffer for storing the result of an iteration.
+ * @param[in] buffers Temporary storage for searching and merging overlaps.
+ * @param[out] overlapping Whether the cluster with the same index is overlapping.
  * @param[in] iterations How many times the function will try to merge overlaps before aborting.
  */
-inline void merge(std::vector<Box> &clusters, std::vector<Box> &temp, const usize iterations)
+inline void merge(std::vector<Box> &clusters,
+                  Buffers &buffers,
+                  std::vector<bool> &overlapping,
+                  const usize iterations)
 {
-	std::vector<Vector2<usize>> overlaps {clusters.size()};
+	if (iterations == 0)
+		throw common::Error<Error::FailedToMergeClusters> {};
 
-	temp.clear();
+	std::vector<usize> &parents = buffers.parents;
+
+	overlapping.clear();
+	overlapping.resize(clusters.size(), false);
 
-	// Repeat the merging process until no new overlaps were detected
 	for (usize j = 0; j < iterations; j++) {
 		const usize size = clusters.size();
+		bool merged = false;
+
+		parents.resize(size);
+		std::iota(parents.begin(), parents.end(), 0);
+
+		impl::intersections(clusters, buffers, [&](usize a, usize b, const Box & /* unused */) {
+			// Ignore clusters that overlap by less than 50%
+			if (impl::overlap(clusters[a], clusters[b]) < 0.5)
+				return;
 
-		if (!impl::search(clusters, overlaps))
+			a = impl::find(parents, a);
+			b = impl::find(parents, b);
+
+			if (a == b)
+				return;
+
+			// The cluster with the lower index represents the set to keep the order stable
+			parents[std::max(a, b)] = std::min(a, b);
+			merged = true;
+		});
+
+		if (!merged)
 			break;
 
+		// Extend the representative of every set by the other clusters in that set
 		for (usize i = 0; i < size; i++) {
-			Box &cluster = clusters[i];
-			bool drop_cluster = false;
-
-			for (const Vector2<usize> &pair : overlaps) {
-				const usize a = pair.x();
-				const usize b = pair.y();
+			const usize root = impl::find(parents, i);
 
-				// If b is the current cluster, it has already been merged
-				if (b == i) {
-					drop_cluster = true;
-					break;
-				}
+			if (root == i)
+				continue;
 
-				// Is this an entry for the current cluster?
-				if (a != i)
-					continue;
+			clusters[root] = clusters[root].merged(clusters[i]);
+			overlapping[root] = true;
+		}
 
-				cluster = cluster.merged(clusters[b]);
-			}
+		usize kept = 0;
 
-			if (drop_cluster)
+		// Drop all clusters that were merged into another one
+		for (usize i = 0; i < size; i++) {
+			if (parents[i] != i)
 				continue;
 
-			temp.push_back(std::move(cluster));
+			clusters[kept] = clusters[i];
+			overlapping[kept] = overlapping[i];
+			kept++;
 		}
 
-		std::swap(clusters, temp);
-		temp.clear();
+		clusters.resize(kept);
+		overlapping.resize(kept);
 	}
 
-	if (iterations == 0)
-		throw common::Error<Error::FailedToMergeClusters> {};
+	// Flag clusters that touch each other, but were not merged
+	impl::intersections(clusters, buffers, [&](usize a, usize b, const Box & /* unused */) {
+		overlapping[a] = true;
+		overlapping[b] = true;
+	});
 }
 
 } // namespace iptsd::contacts::detection::overlaps
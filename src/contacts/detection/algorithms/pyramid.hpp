@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_PYRAMID_HPP
+#define IPTSD_CONTACTS_DETECTION_ALGORITHMS_PYRAMID_HPP
+
+#include "tiles.hpp"
+
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace iptsd::contacts::detection::pyramid {
+
+/*!
+ * Halves the resolution of a heatmap, by taking the maximum of every 2x2 block.
+ *
+ * If the heatmap has an odd number of rows or columns, the last block is smaller.
+ *
+ * @param[in] in The heatmap to downsample.
+ * @param[out] out The downsampled heatmap.
+ */
+template <class Derived>
+void downsample(const DenseBase<Derived> &in, Image<typename DenseBase<Derived>::Scalar> &out)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const Eigen::Index rows = in.rows();
+	const Eigen::Index cols = in.cols();
+
+	const Point size = tiles::count(rows, cols, 2);
+
+	if (out.rows() != size.y() || out.cols() != size.x())
+		out.conservativeResize(size.y(), size.x());
+
+	const Eigen::Index even = cols / 2;
+
+	for (Eigen::Index y = 0; y < size.y(); y++) {
+		const Eigen::Index y0 = y * 2;
+		const Eigen::Index y1 = std::min(y0 + 1, rows - 1);
+
+		// Combine two rows, then combine every two neighbouring columns of the result
+		const auto row = in.derived().row(y0).max(in.derived().row(y1));
+
+		for (Eigen::Index x = 0; x < even; x++)
+			out(y, x) = std::max<T>(row(x * 2), row(x * 2 + 1));
+
+		if (even != size.x())
+			out(y, even) = row(cols - 1);
+	}
+}
+
+/*!
+ * Searches for regions of interest in a mask.
+ *
+ * Every group of connected cells (including diagonal neighbours) is one region.
+ *
+ * @param[in] mask The cells that are part of a region.
+ * @param[in] visited Temporary storage for marking visited cells.
+ * @param[in] stack Temporary storage for the cells that still need to be visited.
+ * @param[out] regions The bounding boxes of all regions, in cells.
+ */
+inline void regions(const Image<bool> &mask,
+                    Image<bool> &visited,
+                    std::vector<Point> &stack,
+                    std::vector<Box> &regions)
+{
+	const Eigen::Index rows = mask.rows();
+	const Eigen::Index cols = mask.cols();
+
+	if (visited.rows() != rows || visited.cols() != cols)
+		visited.conservativeResize(rows, cols);
+
+	visited.setConstant(false);
+	regions.clear();
+
+	for (Eigen::Index y = 0; y < rows; y++) {
+		for (Eigen::Index x = 0; x < cols; x++) {
+			if (!mask(y, x) || visited(y, x))
+				continue;
+
+			Box region {Point {x, y}};
+
+			stack.clear();
+			stack.emplace_back(x, y);
+			visited(y, x) = true;
+
+			while (!stack.empty()) {
+				const Point cell = stack.back();
+				stack.pop_back();
+
+				region.extend(cell);
+
+				const Eigen::Index y0 = std::max<Eigen::Index>(cell.y() - 1, 0);
+				const Eigen::Index y1 = std::min<Eigen::Index>(cell.y() + 1, rows - 1);
+				const Eigen::Index x0 = std::max<Eigen::Index>(cell.x() - 1, 0);
+				const Eigen::Index x1 = std::min<Eigen::Index>(cell.x() + 1, cols - 1);
+
+				for (Eigen::Index ny = y0; ny <= y1; ny++) {
+					for (Eigen::Index nx = x0; nx <= x1; nx++) {
+						if (!mask(ny, nx) || visited(ny, nx))
+							continue;
+
+						visited(ny, nx) = true;
+						stack.emplace_back(nx, ny);
+					}
+				}
+			}
+
+			regions.push_back(region);
+		}
+	}
+}
+
+} // namespace iptsd::contacts::detection::pyramid
+
+#endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_PYRAMID_HPP
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_DETECTION_ALGORITHMS_TILES_HPP
+#define IPTSD_CONTACTS_DETECTION_ALGORITHMS_TILES_HPP
+
+#include <common/types.hpp>
+
+#include <algorithm>
+
+namespace iptsd::contacts::detection::tiles {
+
+/*!
+ * Calculates how many tiles are needed to cover a heatmap.
+ *
+ * @param[in] rows The number of rows of the heatmap.
+ * @param[in] cols The number of columns of the heatmap.
+ * @param[in] size The width and height of a tile.
+ * @return The number of tiles in x and y direction.
+ */
+inline Point count(const Eigen::Index rows, const Eigen::Index cols, const Eigen::Index size)
+{
+	return Point {(cols + size - 1) / size, (rows + size - 1) / size};
+}
+
+/*!
+ * Calculates the pixels that are covered by a range of tiles.
+ *
+ * @param[in] tiles The first and the last tile (inclusive).
+ * @param[in] rows The number of rows of the heatmap.
+ * @param[in] cols The number of columns of the heatmap.
+ * @param[in] size The width and height of a tile.
+ * @return The bounding box of the pixels, limited to the size of the heatmap.
+ */
+inline Box pixels(const Box &tiles,
+                  const Eigen::Index rows,
+                  const Eigen::Index cols,
+                  const Eigen::Index size)
+{
+	const Point min = tiles.min() * size;
+	const Point max = (tiles.max() + Point::Ones()) * size - Point::Ones();
+
+	return Box {min, max.cwiseMin(Point {cols - 1, rows - 1})};
+}
+
+/*!
+ * Searches for tiles of a heatmap that have changed since the previous heatmap.
+ *
+ * The tiles that have changed are copied into the previous heatmap, so that it can be
+ * compared against the next heatmap.
+ *
+ * @param[in] heatmap The current heatmap.
+ * @param[in,out] previous The previous heatmap. Must have the same size as the current one.
+ * @param[in] size The width and height of a tile.
+ * @param[out] changed Whether the tile at the same position has changed.
+ * @return Whether any tile has changed.
+ */
+template <class DerivedHeatmap, class DerivedPrevious>
+bool diff(const DenseBase<DerivedHeatmap> &heatmap,
+          DenseBase<DerivedPrevious> &previous,
+          const Eigen::Index size,
+          Image<bool> &changed)
+{
+	const Eigen::Index rows = heatmap.rows();
+	const Eigen::Index cols = heatmap.cols();
+
+	const Point tiles = count(rows, cols, size);
+
+	if (changed.rows() != tiles.y() || changed.cols() != tiles.x())
+		changed.conservativeResize(tiles.y(), tiles.x());
+
+	bool any = false;
+
+	for (Eigen::Index ty = 0; ty < tiles.y(); ty++) {
+		const Eigen::Index y = ty * size;
+		const Eigen::Index h = std::min(size, rows - y);
+
+		for (Eigen::Index tx = 0; tx < tiles.x(); tx++) {
+			const Eigen::Index x = tx * size;
+			const Eigen::Index w = std::min(size, cols - x);
+
+			const auto current = heatmap.derived().block(y, x, h, w);
+			auto last = previous.derived().block(y, x, h, w);
+
+			const bool different = (current != last).any();
+			changed(ty, tx) = different;
+
+			if (!different)
+				continue;
+
+			last = current;
+			any = true;
+		}
+	}
+
+	return any;
+}
+
+/*!
+ * Marks all tiles that are next to a marked tile.
+ *
+ * @param[in] in The marked tiles.
+ * @param[out] out The marked tiles and all of their neighbours, including diagonal ones.
+ */
+inline void dilate(const Image<bool> &in, Image<bool> &out)
+{
+	const Eigen::Index rows = in.rows();
+	const Eigen::Index cols = in.cols();
+
+	if (out.rows() != rows || out.cols() != cols)
+		out.conservativeResize(rows, cols);
+
+	for (Eigen::Index y = 0; y < rows; y++) {
+		const Eigen::Index y0 = std::max<Eigen::Index>(y - 1, 0);
+		const Eigen::Index y1 = std::min<Eigen::Index>(y + 1, rows - 1);
+
+		for (Eigen::Index x = 0; x < cols; x++) {
+			const Eigen::Index x0 = std::max<Eigen::Index>(x - 1, 0);
+			const Eigen::Index x1 = std::min<Eigen::Index>(x + 1, cols - 1);
+
+			out(y, x) = in.block(y0, x0, y1 - y0 + 1, x1 - x0 + 1).any();
+		}
+	}
+}
+
+/*!
+ * Checks if any of the tiles that cover a region of pixels is marked.
+ *
+ * @param[in] tiles The marked tiles.
+ * @param[in] region The region of pixels.
+ * @param[in] size The width and height of a tile.
+ * @return Whether any of the tiles touched by the region is marked.
+ */
+inline bool any(const Image<bool> &tiles, const Box &region, const Eigen::Index size)
+{
+	const Point min = region.min() / size;
+	const Point max = region.max() / size;
+
+	const Point dims = max - min + Point::Ones();
+	return tiles.block(min.y(), min.x(), dims.y(), dims.x()).any();
+}
+
+} // namespace iptsd::contacts::detection::tiles
+
+#endif // IPTSD_CONTACTS_DETECTION_ALGORITHMS_TILES_HPP
@@ -8,8 +8,26 @@
 #include <common/casts.hpp>
 #include <common/types.hpp>
 
+#include <gsl/gsl>
+
+#include <optional>
+
 namespace iptsd::contacts::detection {
 
+/*
+ * How the shape of a contact is calculated from its cluster.
+ */
+enum class Estimator : u8 {
+	// A gaussian is fitted onto every cluster.
+	GAUSSIAN,
+
+	// The shape is estimated from the moments of every cluster.
+	MOMENTS,
+
+	// Only clusters that overlap with other clusters use gaussian fitting.
+	HYBRID,
+};
+
 template <class T>
 struct Config {
 public:
@@ -38,6 +56,20 @@ public:
 	 */
 	usize neutral_value_backoff = 1;
 
+	/*
+	 * Whether only the regions of the heatmap that changed since the last frame are processed.
+	 * The results of the last frame are reused for the rest of the heatmap.
+	 */
+	bool incremental = false;
+
+	/*
+	 * Whether a downsampled copy of the heatmap is used to find the regions that can contain
+	 * clusters, so that only these regions are processed at full resolution.
+	 * This is ignored if incremental processing is enabled, and for heatmaps that are smaller
+	 * than 512x352 pixels, where the full search is faster.
+	 */
+	bool pyramid = false;
+
 	/*
 	 * If a pixel of the input data is larger than this value plus the neutral value
 	 * it is marked as a contact and a recursive cluster search is started.
@@ -49,6 +81,54 @@ public:
 	 * the recursive cluster search will stop once it reaches it.
 	 */
 	T deactivation_threshold = casts::to<T>(20);
+
+	/*
+	 * How the shape of a contact is calculated from its cluster.
+	 *
+	 * Estimating it from the moments of the cluster is a lot cheaper than gaussian fitting,
+	 * but can't separate contacts that are close to each other.
+	 */
+	Estimator estimator = Estimator::GAUSSIAN;
+
+	/*
+	 * The maximum number of iterations that are used for fitting a gaussian onto a cluster.
+	 */
+	usize fitting_iterations = 3;
+
+	/*
+	 * Fitting a cluster will stop early once the mean changes by less than this value
+	 * (in pixels) and the precision matrix changes by less than this value (relative to
+	 * its norm) between two iterations.
+	 */
+	T fitting_tolerance = gsl::narrow_cast<T>(0.01);
+
+	/*
+	 * Whether clusters should be initialized with the gaussian that was fitted at the
+	 * same position in the previous frame, instead of a generic guess.
+	 */
+	bool fitting_warm_start = true;
+
+	/*
+	 * Clusters whose size (estimated from their moments) is larger than this value are
+	 * emitted as invalid contacts, without calculating their shape with the estimator.
+	 * Uses the same units as the size of a contact.
+	 *
+	 * This should be larger than the maximum size allowed by validation, because the
+	 * estimated size of a cluster is not accurate.
+	 */
+	std::optional<T> rejection_size = std::nullopt;
+
+	/*
+	 * The number of additional threads that are used for fitting clusters in parallel.
+	 * A value of 0 means that all clusters are fitted on the calling thread.
+	 */
+	usize fitting_threads = 0;
+
+	/*
+	 * The minimum number of clusters that have to be fitted for using the additional threads.
+	 * For fewer clusters, waking up the threads takes longer than fitting them serially.
+	 */
+	usize fitting_threads_threshold = 4;
 };
 
 } // namespace iptsd::contacts::detection
@@ -10,17 +10,24 @@
 #include "algorithms/gaussian.hpp"
 #include "algorithms/kernels.hpp"
 #include "algorithms/maximas.hpp"
+#include "algorithms/moments.hpp"
 #include "algorithms/neutral.hpp"
 #include "algorithms/overlaps.hpp"
+#include "algorithms/pyramid.hpp"
+#include "algorithms/tiles.hpp"
 #include "config.hpp"
 
 #include <common/casts.hpp>
+#include <common/thread-pool.hpp>
 #include <common/types.hpp>
 
 #include <gsl/gsl>
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace iptsd::contacts::detection {
@@ -31,6 +38,18 @@ public:
 	static_assert(std::is_floating_point_v<T>);
 	static_assert(std::is_floating_point_v<TFit>);
 
+private:
+	// The size of the tiles that are compared to find changes between two frames.
+	static constexpr Eigen::Index TILE_SIZE = 8;
+
+	/*
+	 * How many pixels a heatmap needs before the pyramid stage is used.
+	 * On smaller heatmaps, finding the regions costs more than it saves. In iptsd-bench
+	 * it was slower up to 256x176 pixels (520μs instead of 490μs), and only faster
+	 * at 512x352 (1593μs instead of 1793μs).
+	 */
+	static constexpr Eigen::Index PYRAMID_MIN_PIXELS = 512 * 352;
+
 private:
 	Config<T> m_config;
 
@@ -52,23 +71,194 @@ private:
 	// The list of spanned clusters.
 	std::vector<Box> m_clusters {};
 
-	// Temporary storage for cluster spanning.
-	std::vector<Box> m_clusters_temp {};
+	// The heatmap that was processed last, for finding changed regions.
+	Image<T> m_previous {};
+
+	// Whether m_previous and the data derived from it can be used for the next frame.
+	bool m_has_previous = false;
+
+	// Whether the tile at this position has changed since the last frame.
+	Image<bool> m_tiles_changed {};
+
+	// Whether the tile at this position is close to a changed tile and has to be recalculated.
+	Image<bool> m_tiles_dirty {};
+
+	// Temporary storage for blurring a region of the heatmap.
+	std::vector<T> m_blur_temp {};
+
+	// The heatmap at half the resolution.
+	Image<T> m_pyramid {};
+
+	// Whether a cell of the downsampled heatmap could be part of a cluster.
+	Image<bool> m_pyramid_mask {};
+
+	// The cells that could be part of a cluster and their neighbours.
+	Image<bool> m_pyramid_regions {};
+
+	// Temporary storage for searching connected cells.
+	Image<bool> m_pyramid_visited {};
+
+	// Temporary storage for searching connected cells.
+	std::vector<Point> m_pyramid_stack {};
+
+	// The regions of the heatmap that were processed in the last frame.
+	std::vector<Box> m_regions {};
+
+	// Whether the blurred heatmap is zero outside of m_regions.
+	bool m_has_regions = false;
+
+	// The clusters that were spanned from every local maximum in the last frame.
+	std::vector<std::pair<Point, Box>> m_spans {};
+
+	// The clusters that were spanned from every local maximum in the current frame.
+	std::vector<std::pair<Point, Box>> m_spans_next {};
+
+	// Temporary storage for marking pixels that were visited during cluster spanning.
+	Image<bool> m_clusters_visited {};
+
+	// Temporary storage for merging overlapping clusters.
+	overlaps::Buffers m_overlaps {};
+
+	// Whether the cluster with the same index overlaps with other clusters.
+	std::vector<bool> m_overlapping {};
 
 	// Input parameters for gaussian fitting.
 	std::vector<gaussian::Parameters<TFit>> m_fitting_params {};
 
+	// The results of gaussian fitting from the previous frame.
+	std::vector<gaussian::Parameters<TFit>> m_fitting_last {};
+
+	// The storage for the weight maps of m_fitting_params.
+	std::vector<TFit> m_fitting_weights {};
+
+	// The storage for the weight maps of m_fitting_last.
+	std::vector<TFit> m_fitting_weights_last {};
+
 	// Temporary storage for gaussian fitting.
 	Image<TFit> m_fitting_temp {};
 
+	// The worker threads for fitting clusters in parallel.
+	std::unique_ptr<common::ThreadPool> m_fitting_pool {};
+
+	// The combined size of all internal buffers after the last frame.
+	usize m_capacity = 0;
+
+	// How many frames required growing the internal buffers.
+	usize m_buffer_growth = 0;
+
 	// How many frames are left before the neutral value has to be recalculated.
 	usize m_counter = 0;
 
 	// The cached neutral value of the heatmap.
 	T m_neutral = casts::to<T>(0);
 
+	// The contacts that were detected in the last frame.
+	std::vector<Contact<T>> m_detected {};
+
+	// Whether m_detected contains the result of the last frame.
+	bool m_has_detected = false;
+
 public:
-	Detector(Config<T> config) : m_config {std::move(config)} {};
+	Detector(Config<T> config) : m_config {std::move(config)}
+	{
+		if (m_config.fitting_threads > 0)
+			m_fitting_pool = std::make_unique<common::ThreadPool>(m_config.fitting_threads);
+	};
+
+	/*!
+	 * Resets the detector by clearing all data that was stored from previous frames.
+	 */
+	void reset()
+	{
+		m_fitting_last.clear();
+		m_has_detected = false;
+		m_has_previous = false;
+
+		// Force recalculating the neutral value
+		m_counter = 0;
+	}
+
+	/*!
+	 * How many frames changed the size of the internal buffers of the detector.
+	 *
+	 * After every frame, the capacity of the vectors and the size of the images that the
+	 * detector keeps between frames are added up. If the sum differs from the previous frame,
+	 * the frame is counted. Once the detector has seen the largest amount of contacts of a
+	 * session, these buffers stop growing, and this value stays the same.
+	 *
+	 * This is not a count of heap allocations. Memory that is allocated outside of these
+	 * buffers, like the list of contacts that is returned, or temporaries created by Eigen,
+	 * is not observed.
+	 *
+	 * @return The number of frames that changed the size of the buffers.
+	 */
+	[[nodiscard]] usize buffer_growth() const
+	{
+		return m_buffer_growth;
+	}
+
+	/*!
+	 * How many of the threads that fit the gaussians could not be pinned to a CPU.
+	 *
+	 * @return The number of unpinned fitting threads.
+	 */
+	[[nodiscard]] usize unpinned_threads() const
+	{
+		return m_fitting_pool ? m_fitting_pool->unpinned() : 0;
+	}
+
+	/*!
+	 * Skips detection for a frame that can't contain any contacts.
+	 *
+	 * A cluster can only be found if the heatmap contains a value larger than the
+	 * activation threshold plus the neutral value. Blurring the heatmap can't make its
+	 * maximum larger, so if the maximum is below that, searching for contacts would not
+	 * find anything. This only works if the neutral value does not need to be recalculated.
+	 *
+	 * @param[in] max The largest value of the heatmap.
+	 * @param[out] contacts The list of detected contacts, which will be empty.
+	 * @return Whether the frame was skipped. If false, @ref detect has to be called instead.
+	 */
+	bool skip(const T max, std::vector<Contact<T>> &contacts)
+	{
+		if (m_counter == 0)
+			return false;
+
+		if (max - m_neutral > m_config.activation_threshold)
+			return false;
+
+		// Update counter
+		m_counter = (m_counter + 1) % m_config.neutral_value_backoff;
+
+		contacts.clear();
+		m_fitting_last.clear();
+
+		m_detected.clear();
+		m_has_detected = true;
+
+		return true;
+	}
+
+	/*!
+	 * Returns the contacts from the last frame again, instead of running detection.
+	 *
+	 * This can be used if the heatmap is identical to the one from the last frame. It only
+	 * works if the neutral value does not need to be recalculated.
+	 *
+	 * @param[out] contacts The list of contacts that were detected in the last frame.
+	 * @return Whether the contacts were repeated. If false, @ref detect has to be called instead.
+	 */
+	bool repeat(std::vector<Contact<T>> &contacts)
+	{
+		if (!m_has_detected || m_counter == 0)
+			return false;
+
+		// Update counter
+		m_counter = (m_counter + 1) % m_config.neutral_value_backoff;
+
+		contacts.assign(m_detected.begin(), m_detected.end());
+		return true;
+	}
 
 	/*!
 	 * Search for contacts in a capacitive heatmap.
@@ -101,12 +291,17 @@ public:
 
 			if (m_config.normalize)
 				m_input_diagonal = std::hypot(dimensions.x(), dimensions.y());
+
+			m_has_previous = false;
+			m_has_regions = false;
 		}
 
 		contacts.clear();
 		m_clusters.clear();
 		m_fitting_params.clear();
 
+		const T neutral = m_neutral;
+
 		// Recalculate the neutral value if neccessary
 		if (m_counter == 0) {
 			m_neutral = neutral::calculate(heatmap,
@@ -117,21 +312,34 @@ public:
 		// Update counter
 		m_counter = (m_counter + 1) % m_config.neutral_value_backoff;
 
-		// Subtract the neutral value from the whole heatmap
-		m_img_neutral = (heatmap - m_neutral).max(casts::to<T>(0));
-
-		// Blur the heatmap slightly
-		convolution::run(m_img_neutral, m_kernel_blur, m_img_blurred);
-
 		const T athresh = m_config.activation_threshold;
 		const T dthresh = m_config.deactivation_threshold;
 
-		// Search for local maximas
-		maximas::find(m_img_blurred, athresh, m_maximas);
+		// If the neutral value changed, every pixel has to be recalculated
+		if (m_config.incremental && m_has_previous && m_neutral == neutral) {
+			this->update_changed(heatmap, athresh);
+		} else if (m_config.pyramid && !m_config.incremental &&
+		           heatmap.size() >= PYRAMID_MIN_PIXELS) {
+			this->update_regions(heatmap, athresh, dthresh);
+		} else {
+			// Subtract the neutral value from the whole heatmap
+			m_img_neutral = (heatmap - m_neutral).max(casts::to<T>(0));
+
+			// Blur the heatmap slightly
+			convolution::run(m_img_neutral, m_kernel_blur, m_img_blurred);
+
+			// Search for local maximas
+			maximas::find(m_img_blurred, athresh, m_maximas);
+
+			if (m_config.incremental)
+				this->update_all(heatmap);
+		}
+
+		m_spans_next.clear();
 
 		// Iterate over the maximas and start building clusters
 		for (const Point &point : m_maximas) {
-			Box cluster = cluster::span(m_img_blurred, point, athresh, dthresh);
+			Box cluster = this->span(point, athresh, dthresh);
 
 			if (cluster.isEmpty())
 				continue;
@@ -150,58 +358,567 @@ public:
 			m_clusters.push_back(std::move(cluster));
 		}
 
+		std::swap(m_spans, m_spans_next);
+
 		// Merge overlapping clusters
-		overlaps::merge(m_clusters, m_clusters_temp, 5);
+		overlaps::merge(m_clusters, m_overlaps, m_overlapping, 5);
+
+		// Reject palms before spending time on fitting them
+		if (m_config.rejection_size.has_value())
+			this->reject_palms(dimensions, contacts);
+
+		const usize clusters = m_clusters.size();
+
+		usize weights = 0;
+
+		// Calculate how much storage the weight maps need
+		for (usize i = 0; i < clusters; i++) {
+			if (this->needs_fitting(i))
+				weights += casts::to_unsigned(overlaps::impl::area(m_clusters[i]));
+		}
+
+		if (m_fitting_weights.size() < weights)
+			m_fitting_weights.resize(weights);
+
+		// The weight maps are handed out from the pool, instead of allocating them
+		gsl::span<TFit> pool {m_fitting_weights};
 
 		// Prepare clusters for gaussian fitting
-		for (const Box &cluster : m_clusters) {
-			const Vector2<TFit> mean = cluster.cast<TFit>().center();
-			const Matrix2<TFit> prec = Matrix2<TFit>::Identity();
+		for (usize i = 0; i < clusters; i++) {
+			if (!this->needs_fitting(i))
+				continue;
+
+			const Box &cluster = m_clusters[i];
+
+			Vector2<TFit> mean = cluster.cast<TFit>().center();
+			Matrix2<TFit> prec = Matrix2<TFit>::Identity();
+			TFit scale = 1;
+
+			if (m_config.fitting_warm_start)
+				this->warm_start(cluster, mean, prec, scale);
 
 			// min() and max() are inclusive so we need to add one
 			const Vector2<Eigen::Index> size = cluster.sizes() + one;
 
+			const usize area = casts::to_unsigned(size.prod());
+
 			gaussian::Parameters<TFit> params {
 				true,
-				1,
+				scale,
 				mean,
 				prec,
 				cluster,
-				Image<TFit> {size.y(), size.x()},
+				pool.subspan(0, area),
 			};
 
 			m_fitting_params.push_back(std::move(params));
+			pool = pool.subspan(area);
 		}
 
 		// Run gaussian fitting
-		gaussian::fit(m_fitting_params, m_img_blurred, m_fitting_temp, 3);
+		gaussian::fit(m_fitting_params,
+		              m_img_blurred,
+		              m_fitting_temp,
+		              m_config.fitting_iterations,
+		              gsl::narrow_cast<TFit>(m_config.fitting_tolerance),
+		              [&](const usize count, const auto &func) {
+			              if (m_fitting_pool && count >= m_config.fitting_threads_threshold)
+				              m_fitting_pool->run(count, func);
+			              else
+				              gaussian::impl::Serial {}(count, func);
+		              });
+
+		// Estimate the remaining clusters from their moments
+		for (usize i = 0; i < clusters; i++) {
+			if (this->needs_fitting(i))
+				continue;
+
+			gaussian::Parameters<TFit> params {};
+			Matrix2<TFit> cov {};
+
+			params.bounds = m_clusters[i];
+			params.converged = true;
+			params.valid = moments::estimate(m_img_blurred,
+			                                 params.bounds,
+			                                 params.mean,
+			                                 cov,
+			                                 params.scale);
+
+			if (params.valid)
+				params.prec = cov.inverse();
+
+			m_fitting_params.push_back(std::move(params));
+		}
+
+		// Keep the results around for initializing the next frame
+		std::swap(m_fitting_params, m_fitting_last);
+		std::swap(m_fitting_weights, m_fitting_weights_last);
 
 		// Create a contact from every gaussian fitting parameter
-		for (const auto &p : m_fitting_params) {
+		for (const auto &p : m_fitting_last) {
 			if (!p.valid)
 				continue;
 
 			const Matrix2<TFit> cov = p.prec.inverse();
+			contacts.push_back(this->make_contact(p.mean, cov, dimensions));
+		}
+
+		// Keep a copy of the results, in case the next heatmap is identical
+		m_detected.assign(contacts.begin(), contacts.end());
+		m_has_detected = true;
+
+		this->count_buffer_growth();
+	}
+
+private:
+	/*!
+	 * Marks the whole heatmap as changed, after it was processed without using the last frame.
+	 *
+	 * @param[in] heatmap The heatmap that was processed.
+	 */
+	template <class Derived>
+	void update_all(const DenseBase<Derived> &heatmap)
+	{
+		const Point tiles = tiles::count(heatmap.rows(), heatmap.cols(), TILE_SIZE);
+
+		m_previous = heatmap;
+		m_has_previous = true;
+
+		m_tiles_dirty.conservativeResize(tiles.y(), tiles.x());
+		m_tiles_dirty.setConstant(true);
+	}
+
+	/*!
+	 * Only processes the regions of the heatmap that have changed since the last frame.
+	 *
+	 * The heatmap is compared against the last one in tiles. Tiles that have changed, and
+	 * their neighbours, are recalculated, while the rest of the data is kept from the last
+	 * frame. Because every step only looks at the direct neighbours of a pixel, the result
+	 * is the same as processing the whole heatmap.
+	 *
+	 * @param[in] heatmap The heatmap to process.
+	 * @param[in] athresh The activation threshold for searching local maximas.
+	 */
+	template <class Derived>
+	void update_changed(const DenseBase<Derived> &heatmap, const T athresh)
+	{
+		tiles::diff(heatmap, m_previous, TILE_SIZE, m_tiles_changed);
+		tiles::dilate(m_tiles_changed, m_tiles_dirty);
+
+		const auto dirty = [&](const Point &point) {
+			return m_tiles_dirty(point.y() / TILE_SIZE, point.x() / TILE_SIZE);
+		};
+
+		// Drop all maximas that will be searched again
+		m_maximas.erase(std::remove_if(m_maximas.begin(), m_maximas.end(), dirty),
+		                m_maximas.end());
+
+		// The maximas need the blurred values of the neighbouring regions
+		this->for_each_dirty([&](const Box &region) { this->blur_region(heatmap, region); });
+
+		this->for_each_dirty([&](const Box &region) {
+			maximas::find(m_img_blurred, athresh, region, m_maximas);
+		});
+
+		// Restore the order of a full search
+		std::sort(m_maximas.begin(), m_maximas.end(), Detector::scan_order);
+	}
+
+	/*!
+	 * Only processes the regions of the heatmap where clusters can be found.
+	 *
+	 * The heatmap is downsampled to half of its resolution, and every cell that is above the
+	 * deactivation threshold is marked, together with its neighbours. The bounding boxes of
+	 * the connected groups of cells are large enough to contain all clusters and the pixels
+	 * around them, so only these regions are blurred and searched for local maximas.
+	 * Everything outside of the regions is set to zero.
+	 *
+	 * @param[in] heatmap The heatmap to process.
+	 * @param[in] athresh The activation threshold.
+	 * @param[in] dthresh The deactivation threshold.
+	 */
+	template <class Derived>
+	void update_regions(const DenseBase<Derived> &heatmap, const T athresh, const T dthresh)
+	{
+		const Eigen::Index rows = heatmap.rows();
+		const Eigen::Index cols = heatmap.cols();
+
+		// Only the regions of the last frame can contain anything but zeros
+		if (m_has_regions) {
+			for (const Box &region : m_regions) {
+				const Point size = region.sizes() + Point::Ones();
+
+				m_img_blurred.block(region.min().y(), region.min().x(), size.y(), size.x())
+					.setZero();
+			}
+		} else {
+			m_img_blurred.setZero();
+			m_has_regions = true;
+		}
+
+		pyramid::downsample(heatmap, m_pyramid);
+
+		m_pyramid_mask = (m_pyramid - m_neutral) > dthresh;
+		tiles::dilate(m_pyramid_mask, m_pyramid_regions);
+
+		pyramid::regions(m_pyramid_regions, m_pyramid_visited, m_pyramid_stack, m_regions);
+
+		for (Box &region : m_regions) {
+			region = tiles::pixels(region, rows, cols, 2);
+			this->blur_region(heatmap, region);
+		}
+
+		m_maximas.clear();
+
+		// The regions can overlap, so the maximas have to be searched after blurring
+		for (const Box &region : m_regions)
+			maximas::find(m_img_blurred, athresh, region, m_maximas);
+
+		// Restore the order of a full search and remove maximas that were found twice
+		std::sort(m_maximas.begin(), m_maximas.end(), Detector::scan_order);
+		m_maximas.erase(std::unique(m_maximas.begin(), m_maximas.end()), m_maximas.end());
+	}
+
+	/*!
+	 * Subtracts the neutral value from a region of the heatmap and blurs it.
+	 *
+	 * @param[in] heatmap The heatmap to process.
+	 * @param[in] region The region of the heatmap that will be written to m_img_blurred.
+	 */
+	template <class Derived>
+	void blur_region(const DenseBase<Derived> &heatmap, const Box &region)
+	{
+		const Vector2<Eigen::Index> one = Vector2<Eigen::Index>::Ones();
+		const Vector2<Eigen::Index> dimensions {heatmap.cols() - 1, heatmap.rows() - 1};
+
+		// The blur needs one more pixel on each side of the region
+		const Box outer {(region.min() - one).cwiseMax(0),
+		                 (region.max() + one).cwiseMin(dimensions)};
+
+		const Point size = region.sizes() + one;
+		const Point osize = outer.sizes() + one;
+		const Point offset = region.min() - outer.min();
+
+		const Eigen::Index area = osize.prod();
+
+		if (m_blur_temp.size() < casts::to_unsigned(area * 2))
+			m_blur_temp.resize(casts::to_unsigned(heatmap.size() * 2));
+
+		Eigen::Map<Image<T>> in {m_blur_temp.data(), osize.y(), osize.x()};
+		Eigen::Map<Image<T>> out {m_blur_temp.data() + area, osize.y(), osize.x()};
+
+		in = (heatmap.derived().block(outer.min().y(), outer.min().x(), osize.y(), osize.x()) -
+		      m_neutral)
+		             .max(casts::to<T>(0));
+
+		convolution::run(in, m_kernel_blur, out);
+
+		m_img_blurred.block(region.min().y(), region.min().x(), size.y(), size.x()) =
+			out.block(offset.y(), offset.x(), size.y(), size.x());
+	}
+
+	/*!
+	 * Compares two points by the order in which a search through the heatmap finds them.
+	 *
+	 * @param[in] a The first point.
+	 * @param[in] b The second point.
+	 * @return Whether a comes before b.
+	 */
+	static bool scan_order(const Point &a, const Point &b)
+	{
+		return a.y() < b.y() || (a.y() == b.y() && a.x() < b.x());
+	}
+
+	/*!
+	 * Calls a function for every region of the heatmap that has to be recalculated.
+	 *
+	 * Neighbouring tiles in the same row are combined into one region.
+	 *
+	 * @param[in] func Called with the bounds of every region.
+	 */
+	template <class Func>
+	void for_each_dirty(Func &&func) const
+	{
+		const Eigen::Index rows = m_img_neutral.rows();
+		const Eigen::Index cols = m_img_neutral.cols();
+
+		const Eigen::Index trows = m_tiles_dirty.rows();
+		const Eigen::Index tcols = m_tiles_dirty.cols();
+
+		for (Eigen::Index ty = 0; ty < trows; ty++) {
+			Eigen::Index tx = 0;
+
+			while (tx < tcols) {
+				if (!m_tiles_dirty(ty, tx)) {
+					tx++;
+					continue;
+				}
+
+				const Eigen::Index start = tx;
+
+				while (tx < tcols && m_tiles_dirty(ty, tx))
+					tx++;
+
+				const Box tiles {Point {start, ty}, Point {tx - 1, ty}};
+				func(tiles::pixels(tiles, rows, cols, TILE_SIZE));
+			}
+		}
+	}
+
+	/*!
+	 * Spans a cluster from a local maximum.
+	 *
+	 * If the cluster was spanned from the same point in the last frame, and none of the
+	 * pixels it depends on have changed since then, the result of the last frame is reused.
+	 *
+	 * @param[in] point The local maximum.
+	 * @param[in] athresh The activation threshold.
+	 * @param[in] dthresh The deactivation threshold.
+	 * @return The bounding box of the spanned cluster.
+	 */
+	Box span(const Point &point, const T athresh, const T dthresh)
+	{
+		if (!m_config.incremental)
+			return cluster::span(m_img_blurred, point, athresh, dthresh, m_clusters_visited);
+
+		const Vector2<Eigen::Index> one = Vector2<Eigen::Index>::Ones();
+		const Vector2<Eigen::Index> dimensions {m_img_blurred.cols() - 1,
+		                                        m_img_blurred.rows() - 1};
+
+		const auto compare = [](const std::pair<Point, Box> &span, const Point &p) {
+			return Detector::scan_order(span.first, p);
+		};
+
+		const auto it = std::lower_bound(m_spans.begin(), m_spans.end(), point, compare);
+
+		if (it != m_spans.end() && it->first == point && !it->second.isEmpty()) {
+			// Spanning a cluster looks at its pixels and their direct neighbours
+			const Box region {(it->second.min() - one).cwiseMax(0),
+			                  (it->second.max() + one).cwiseMin(dimensions)};
+
+			if (!tiles::any(m_tiles_dirty, region, TILE_SIZE)) {
+				m_spans_next.push_back(*it);
+				return it->second;
+			}
+		}
+
+		const Box cluster =
+			cluster::span(m_img_blurred, point, athresh, dthresh, m_clusters_visited);
+
+		m_spans_next.emplace_back(point, cluster);
+		return cluster;
+	}
+
+	/*!
+	 * Creates a contact from the parameters of a gaussian.
+	 *
+	 * @param[in] mean The center of the gaussian.
+	 * @param[in] cov The covariance matrix of the gaussian.
+	 * @param[in] dimensions The largest valid coordinates of the heatmap.
+	 * @return The contact, with normalized dimensions if enabled.
+	 */
+	template <class S>
+	Contact<T> make_contact(const Vector2<S> &mean,
+	                        const Matrix2<S> &cov,
+	                        const Vector2<Eigen::Index> &dimensions) const
+	{
+		Eigen::SelfAdjointEigenSolver<Matrix2<S>> solver {};
+		solver.computeDirect(cov);
+
+		Vector2<S> position = mean;
+		Vector2<S> size = ellipse::size(solver.eigenvalues());
+		S orientation = ellipse::angle<S>(solver.eigenvectors());
+
+		// Normalize dimensions.
+		if (m_config.normalize) {
+			position = position.cwiseQuotient(dimensions.cast<S>());
+			size = (size.array() / m_input_diagonal).matrix();
+			orientation /= gsl::narrow_cast<S>(M_PI);
+		}
+
+		return Contact<T> {position.template cast<T>(),
+		                   size.template cast<T>(),
+		                   gsl::narrow_cast<T>(orientation),
+		                   m_config.normalize};
+	}
+
+	/*!
+	 * Removes clusters that are too large to be a finger.
+	 *
+	 * A palm creates the largest clusters, which are the most expensive ones to fit,
+	 * only for the contact to be discarded by validation afterwards. Instead, the size of
+	 * these clusters is estimated from their moments, and they are emitted as invalid
+	 * contacts directly, so that they can still be used for palm rejection.
+	 *
+	 * @param[in] dimensions The largest valid coordinates of the heatmap.
+	 * @param[out] contacts The list of detected contacts, where the palms are added.
+	 */
+	void reject_palms(const Vector2<Eigen::Index> &dimensions, std::vector<Contact<T>> &contacts)
+	{
+		const Vector2<Eigen::Index> one = Vector2<Eigen::Index>::Ones();
+		const usize clusters = m_clusters.size();
+
+		T limit = m_config.rejection_size.value();
+
+		if (m_config.normalize)
+			limit *= m_input_diagonal;
+
+		usize kept = 0;
+
+		for (usize i = 0; i < clusters; i++) {
+			const Box cluster = m_clusters[i];
+			const bool overlapping = m_overlapping[i];
+
+			const Vector2<T> size = (cluster.sizes() + one).template cast<T>();
+
+			Vector2<T> mean {};
+			Matrix2<T> cov {};
+			T scale {};
 
-			Eigen::SelfAdjointEigenSolver<Matrix2<TFit>> solver {};
-			solver.computeDirect(cov);
+			/*
+			 * The estimated diameter of a cluster can never be larger than the diagonal
+			 * of its bounding box, so the moments only need to be calculated for large boxes.
+			 */
+			const bool palm = size.norm() > limit &&
+			                  moments::estimate(m_img_blurred, cluster, mean, cov, scale) &&
+			                  this->is_palm(cov, limit);
 
-			Vector2<TFit> mean = p.mean;
-			Vector2<TFit> size = ellipse::size(solver.eigenvalues());
-			TFit orientation = ellipse::angle<TFit>(solver.eigenvectors());
+			if (!palm) {
+				m_clusters[kept] = cluster;
+				m_overlapping[kept] = overlapping;
+				kept++;
 
-			// Normalize dimensions.
-			if (m_config.normalize) {
-				mean = mean.cwiseQuotient(dimensions.cast<TFit>());
-				size = (size.array() / m_input_diagonal).matrix();
-				orientation /= gsl::narrow_cast<TFit>(M_PI);
+				continue;
 			}
 
-			contacts.push_back(Contact<T> {mean.template cast<T>(),
-			                               size.template cast<T>(),
-			                               gsl::narrow_cast<T>(orientation),
-			                               m_config.normalize});
+			Contact<T> contact = this->make_contact(mean, cov, dimensions);
+			contact.valid = false;
+
+			contacts.push_back(std::move(contact));
 		}
+
+		m_clusters.resize(kept);
+		m_overlapping.resize(kept);
+	}
+
+	/*!
+	 * Checks if the estimated shape of a cluster is larger than the rejection size.
+	 *
+	 * @param[in] cov The estimated covariance matrix of the cluster.
+	 * @param[in] limit The rejection size in pixels.
+	 * @return Whether the major axis of the cluster is larger than the limit.
+	 */
+	[[nodiscard]] static bool is_palm(const Matrix2<T> &cov, const T limit)
+	{
+		Eigen::SelfAdjointEigenSolver<Matrix2<T>> solver {};
+		solver.computeDirect(cov, Eigen::EigenvaluesOnly);
+
+		return ellipse::size(solver.eigenvalues()).maxCoeff() > limit;
+	}
+
+	/*!
+	 * Checks whether the shape of a cluster has to be calculated with gaussian fitting.
+	 *
+	 * @param[in] index The index of the cluster.
+	 * @return Whether the cluster needs gaussian fitting, or can be estimated from its moments.
+	 */
+	[[nodiscard]] bool needs_fitting(const usize index) const
+	{
+		switch (m_config.estimator) {
+		case Estimator::MOMENTS:
+			return false;
+		case Estimator::HYBRID:
+			return m_overlapping[index];
+		default:
+			return true;
+		}
+	}
+
+	/*!
+	 * Initializes the fitting parameters of a cluster from the previous frame.
+	 *
+	 * If the cluster contains the mean of a gaussian that was fitted in the previous frame,
+	 * it is likely to be the same contact. Starting from the old parameters lets the fitting
+	 * converge quicker, especially for contacts that are resting or moving slowly.
+	 *
+	 * @param[in] cluster The cluster that is being initialized.
+	 * @param[in,out] mean The initial guess for the mean.
+	 * @param[in,out] prec The initial guess for the precision matrix.
+	 * @param[in,out] scale The initial guess for the scale.
+	 */
+	void warm_start(const Box &cluster, Vector2<TFit> &mean, Matrix2<TFit> &prec, TFit &scale)
+	{
+		const Eigen::AlignedBox<TFit, 2> bounds = cluster.cast<TFit>();
+		const Vector2<TFit> center = bounds.center();
+
+		const gaussian::Parameters<TFit> *best = nullptr;
+		TFit distance = Eigen::NumTraits<TFit>::infinity();
+
+		for (const auto &p : m_fitting_last) {
+			if (!p.valid || !bounds.contains(p.mean))
+				continue;
+
+			// Only start from gaussians that are not degenerated
+			if (p.prec(0, 0) <= 0 || p.prec.determinant() <= 0)
+				continue;
+
+			const TFit d = (p.mean - center).squaredNorm();
+
+			if (d >= distance)
+				continue;
+
+			best = &p;
+			distance = d;
+		}
+
+		if (best == nullptr)
+			return;
+
+		mean = best->mean;
+		prec = best->prec;
+		scale = best->scale;
+	}
+
+	/*!
+	 * Checks if the size of any internal buffer changed while processing the current frame.
+	 */
+	void count_buffer_growth()
+	{
+		usize capacity = 0;
+
+		capacity += m_maximas.capacity();
+		capacity += m_clusters.capacity();
+		capacity += m_overlaps.parents.capacity();
+		capacity += m_overlaps.cells.capacity();
+		capacity += m_overlaps.entries.capacity();
+		capacity += m_overlapping.capacity();
+		capacity += m_fitting_params.capacity();
+		capacity += m_fitting_last.capacity();
+		capacity += m_fitting_weights.capacity();
+		capacity += m_fitting_weights_last.capacity();
+		capacity += m_detected.capacity();
+		capacity += m_blur_temp.capacity();
+		capacity += m_spans.capacity();
+		capacity += m_spans_next.capacity();
+		capacity += m_pyramid_stack.capacity();
+		capacity += m_regions.capacity();
+
+		capacity += casts::to_unsigned(m_img_neutral.size());
+		capacity += casts::to_unsigned(m_img_blurred.size());
+		capacity += casts::to_unsigned(m_clusters_visited.size());
+		capacity += casts::to_unsigned(m_fitting_temp.size());
+		capacity += casts::to_unsigned(m_previous.size());
+		capacity += casts::to_unsigned(m_tiles_changed.size());
+		capacity += casts::to_unsigned(m_tiles_dirty.size());
+		capacity += casts::to_unsigned(m_pyramid.size());
+		capacity += casts::to_unsigned(m_pyramid_mask.size());
+		capacity += casts::to_unsigned(m_pyramid_regions.size());
+		capacity += casts::to_unsigned(m_pyramid_visited.size());
+
+		if (capacity != m_capacity)
+			m_buffer_growth++;
+
+		m_capacity = capacity;
 	}
 };
 
@@ -6,10 +6,14 @@
 #include "config.hpp"
 #include "contact.hpp"
 #include "detection/detector.hpp"
+#include "frame.hpp"
+#include "history.hpp"
+#include "prediction/predictor.hpp"
 #include "stability/stabilizer.hpp"
 #include "tracking/tracker.hpp"
 #include "validation/validator.hpp"
 
+#include <common/casts.hpp>
 #include <common/types.hpp>
 
 #include <type_traits>
@@ -28,7 +32,10 @@ private:
 	detection::Detector<T, TFit> m_detector;
 
 	// Tracks contacts over multiple frames.
-	tracking::Tracker<T> m_tracker {};
+	tracking::Tracker<T> m_tracker;
+
+	// Predicts the movement of contacts.
+	prediction::Predictor<T> m_predictor;
 
 	// Stabilizes size and movement of contacts.
 	stability::Stabilizer<T> m_stabilizer;
@@ -36,27 +43,73 @@ private:
 	// Validates size and aspect ratio of contacts.
 	validation::Validator<T> m_validator;
 
+	// The contacts from the previous frames, shared by all stages.
+	History<T> m_history;
+
+	// The contacts of the current frame, stored for batched processing.
+	ContactFrame<T> m_frame {};
+
+	// How many contacts were dropped because they didn't fit into a frame.
+	usize m_dropped = 0;
+
 public:
 	Finder(Config<T> config)
 		: m_detector {config.detection},
+		  m_tracker {config.tracking},
+		  m_predictor {config.prediction},
 		  m_stabilizer {config.stability},
-		  m_validator {config.validation} {};
+		  m_validator {config.validation},
+		  m_history {config.history} {};
 
 	/*!
 	 * Resets the contact finder by clearing all stored previous frames.
 	 */
 	void reset()
 	{
-		m_tracker.reset();
-		m_stabilizer.reset();
-		m_validator.reset();
+		m_detector.reset();
+		m_predictor.reset();
+		m_history.reset();
+	}
+
+	/*!
+	 * How many frames changed the size of the internal buffers of the contact detection.
+	 *
+	 * @return The number of frames that changed the size of the buffers.
+	 */
+	[[nodiscard]] usize buffer_growth() const
+	{
+		return m_detector.buffer_growth();
+	}
+
+	/*!
+	 * How many threads of the contact detection could not be pinned to a CPU.
+	 *
+	 * @return The number of unpinned threads.
+	 */
+	[[nodiscard]] usize unpinned_threads() const
+	{
+		return m_detector.unpinned_threads();
+	}
+
+	/*!
+	 * How many contacts were dropped because a frame contained too many of them.
+	 *
+	 * The contacts of a frame are stored without allocating memory, which limits a frame to
+	 * ContactFrame<T>::CAPACITY (64) contacts. Any contacts beyond that are discarded.
+	 *
+	 * @return The number of dropped contacts.
+	 */
+	[[nodiscard]] usize dropped_contacts() const
+	{
+		return m_dropped;
 	}
 
 	/*!
 	 * Extracts contacts from a capacitive heatmap.
 	 *
 	 * After the initial detection phase, every contact will be assigned a uniqe
-	 * index that identifies them over multiple consecutive frames.
+	 * index that identifies them over multiple consecutive frames. If enabled, the
+	 * movement of the contacts is predicted, to compensate for the processing latency.
 	 *
 	 * Then the size and aspect ratio of the contact is validated, and it is
 	 * checked if the changes to the contact over the last frames have been stable.
@@ -68,9 +121,88 @@ public:
 	void find(const ImageBase<T, Rows, Cols> &heatmap, std::vector<Contact<T>> &contacts)
 	{
 		m_detector.detect(heatmap, contacts);
-		m_tracker.track(contacts);
-		m_stabilizer.stabilize(contacts);
-		m_validator.validate(contacts);
+		this->process(contacts);
+	}
+
+	/*!
+	 * Processes a frame without running detection, if the heatmap can't contain contacts.
+	 *
+	 * The empty frame is still passed through tracking, stability and validity checks,
+	 * so that all contacts from the previous frame are lifted.
+	 *
+	 * @param[in] max The largest value of the capacitive heatmap.
+	 * @param[out] contacts The list of found contacts, which will be empty.
+	 * @return Whether the frame was processed. If false, @ref find has to be called instead.
+	 */
+	bool skip(const T max, std::vector<Contact<T>> &contacts)
+	{
+		if (!m_detector.skip(max, contacts))
+			return false;
+
+		this->process(contacts);
+
+		return true;
+	}
+
+	/*!
+	 * Processes a frame with the same heatmap as the last one, without running detection.
+	 *
+	 * The contacts that were detected in the last frame are passed through tracking,
+	 * stability and validity checks again.
+	 *
+	 * @param[out] contacts The list of found contacts.
+	 * @return Whether the frame was processed. If false, @ref find has to be called instead.
+	 */
+	bool repeat(std::vector<Contact<T>> &contacts)
+	{
+		if (!m_detector.repeat(contacts))
+			return false;
+
+		this->process(contacts);
+
+		return true;
+	}
+
+private:
+	/*!
+	 * Runs all stages after detection over the contacts of a frame.
+	 *
+	 * If prediction is enabled, contacts are matched with the position where the contacts
+	 * from the last frame are expected, instead of their last position.
+	 *
+	 * Stabilization and validation process all contacts at once, using a structure of arrays.
+	 * Afterwards, the contacts are added to the history for processing the next frame.
+	 * Only then are the reported positions extrapolated, so that all stages and the history
+	 * work with the measured positions.
+	 *
+	 * @param[in,out] contacts The list of contacts to process.
+	 */
+	void process(std::vector<Contact<T>> &contacts)
+	{
+		const usize capacity = casts::to_unsigned(ContactFrame<T>::CAPACITY);
+
+		// A frame with that many contacts can't be real, drop the contacts that don't fit.
+		if (contacts.size() > capacity) {
+			m_dropped += contacts.size() - capacity;
+			contacts.resize(capacity);
+		}
+
+		if (m_predictor.enabled())
+			m_tracker.track(contacts, m_predictor.expected(), m_history);
+		else
+			m_tracker.track(contacts, m_history);
+
+		m_predictor.predict(contacts);
+		m_frame.load(contacts);
+
+		m_stabilizer.stabilize(m_frame, m_history);
+		m_validator.validate(m_frame, m_history);
+
+		m_frame.store(contacts);
+
+		m_history.push(contacts);
+
+		m_predictor.extrapolate(contacts);
 	}
 };
 
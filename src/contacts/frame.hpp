@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_FRAME_HPP
+#define IPTSD_CONTACTS_FRAME_HPP
+
+#include "contact.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::contacts {
+
+/*!
+ * Stores the contacts of a frame as a structure of arrays.
+ *
+ * Every property of the contacts is stored in its own array, with one column per contact.
+ * This allows processing all contacts of a frame at once, using vectorized operations.
+ * The optional properties of a contact are stored as bitmasks, where bit i belongs to contact i.
+ */
+template <class T>
+class ContactFrame {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+	using Mask = u64;
+
+	// The maximum number of contacts, limited by the number of bits in a mask.
+	static constexpr Eigen::Index CAPACITY = 64;
+
+	// One value for every contact, stored without allocating memory.
+	template <class U>
+	using Values = Eigen::Array<U, 1, Eigen::Dynamic, Eigen::RowMajor, 1, CAPACITY>;
+
+	// Two values for every contact, stored without allocating memory.
+	template <class U>
+	using Vectors = Eigen::Array<U, 2, Eigen::Dynamic, Eigen::ColMajor, 2, CAPACITY>;
+
+public:
+	/*
+	 * The center positions of the contacts.
+	 */
+	Eigen::Array<T, 2, CAPACITY> means = Eigen::Array<T, 2, CAPACITY>::Zero();
+
+	/*
+	 * The sizes of the contacts (diameter of major and minor axis).
+	 */
+	Eigen::Array<T, 2, CAPACITY> sizes = Eigen::Array<T, 2, CAPACITY>::Zero();
+
+	/*
+	 * The orientations of the contacts.
+	 */
+	Eigen::Array<T, 1, CAPACITY> orientations = Eigen::Array<T, 1, CAPACITY>::Zero();
+
+	/*
+	 * The indices of the contacts. Only set if the bit in has_index is set.
+	 */
+	std::array<usize, CAPACITY> indices {};
+
+	/*
+	 * Which contacts have an index.
+	 */
+	Mask has_index = 0;
+
+	/*
+	 * Which contacts have been checked for validity.
+	 */
+	Mask has_valid = 0;
+
+	/*
+	 * Which contacts are valid. Only meaningful if the bit in has_valid is set.
+	 */
+	Mask valid = 0;
+
+	/*
+	 * Which contacts have been checked for stability.
+	 */
+	Mask has_stable = 0;
+
+	/*
+	 * Which contacts are stable. Only meaningful if the bit in has_stable is set.
+	 */
+	Mask stable = 0;
+
+	/*
+	 * Whether the stored values are normalized.
+	 */
+	bool normalized = false;
+
+	/*
+	 * The number of contacts in the frame.
+	 */
+	Eigen::Index count = 0;
+
+public:
+	/*!
+	 * The bit that belongs to a contact.
+	 *
+	 * @param[in] i The position of the contact in the frame.
+	 * @return A mask with only the bit of the contact set.
+	 */
+	static constexpr Mask bit(const Eigen::Index i)
+	{
+		return Mask {1} << casts::to_unsigned(i);
+	}
+
+	/*!
+	 * A mask that contains all contacts of the frame.
+	 *
+	 * @return A mask where the bits of all contacts are set.
+	 */
+	[[nodiscard]] Mask all() const
+	{
+		if (count >= CAPACITY)
+			return ~Mask {0};
+
+		return ContactFrame::bit(count) - 1;
+	}
+
+	/*!
+	 * Removes all contacts from the frame.
+	 */
+	void clear()
+	{
+		has_index = 0;
+		has_valid = 0;
+		valid = 0;
+		has_stable = 0;
+		stable = 0;
+		count = 0;
+	}
+
+	/*!
+	 * Stores a contact in the frame.
+	 *
+	 * @param[in] i The position of the contact in the frame. Must be smaller than the capacity.
+	 * @param[in] contact The contact to store.
+	 */
+	void set(const Eigen::Index i, const Contact<T> &contact)
+	{
+		const Mask b = ContactFrame::bit(i);
+
+		means.col(i) = contact.mean;
+		sizes.col(i) = contact.size;
+		orientations(i) = contact.orientation;
+
+		indices[casts::to_unsigned(i)] = contact.index.value_or(0);
+
+		has_index = ContactFrame::assign(has_index, b, contact.index.has_value());
+		has_valid = ContactFrame::assign(has_valid, b, contact.valid.has_value());
+		valid = ContactFrame::assign(valid, b, contact.valid.value_or(false));
+		has_stable = ContactFrame::assign(has_stable, b, contact.stable.has_value());
+		stable = ContactFrame::assign(stable, b, contact.stable.value_or(false));
+	}
+
+	/*!
+	 * Reads a contact from the frame.
+	 *
+	 * @param[in] i The position of the contact in the frame.
+	 * @return The contact at that position.
+	 */
+	[[nodiscard]] Contact<T> get(const Eigen::Index i) const
+	{
+		const Mask b = ContactFrame::bit(i);
+
+		Contact<T> contact {};
+
+		contact.mean = means.col(i);
+		contact.size = sizes.col(i);
+		contact.orientation = orientations(i);
+		contact.normalized = normalized;
+
+		if ((has_index & b) != 0)
+			contact.index = indices[casts::to_unsigned(i)];
+
+		if ((has_valid & b) != 0)
+			contact.valid = (valid & b) != 0;
+
+		if ((has_stable & b) != 0)
+			contact.stable = (stable & b) != 0;
+
+		return contact;
+	}
+
+	/*!
+	 * Loads a list of contacts into the frame.
+	 *
+	 * @param[in] contacts The contacts to load. Contacts beyond the capacity are ignored.
+	 */
+	void load(const std::vector<Contact<T>> &contacts)
+	{
+		this->clear();
+
+		count = std::min(casts::to_eigen(contacts.size()), CAPACITY);
+
+		if (count > 0)
+			normalized = contacts.front().normalized;
+
+		for (Eigen::Index i = 0; i < count; i++)
+			this->set(i, contacts[casts::to_unsigned(i)]);
+	}
+
+	/*!
+	 * Writes all contacts of the frame into a list.
+	 *
+	 * @param[out] contacts The list of contacts.
+	 */
+	void store(std::vector<Contact<T>> &contacts) const
+	{
+		contacts.resize(casts::to_unsigned(count));
+
+		for (Eigen::Index i = 0; i < count; i++)
+			contacts[casts::to_unsigned(i)] = this->get(i);
+	}
+
+	/*!
+	 * Converts an array of booleans into a mask.
+	 *
+	 * @param[in] flags One boolean per contact.
+	 * @return A mask where bit i is set if the flag of contact i is set.
+	 */
+	template <class Derived>
+	static Mask mask(const DenseBase<Derived> &flags)
+	{
+		Mask out = 0;
+
+		for (Eigen::Index i = 0; i < flags.size(); i++)
+			out |= flags(i) ? ContactFrame::bit(i) : 0;
+
+		return out;
+	}
+
+	/*!
+	 * Converts a mask into an array of booleans.
+	 *
+	 * @param[in] in The mask to convert.
+	 * @param[in] count The number of contacts.
+	 * @return One boolean per contact, set if the bit of the contact is set.
+	 */
+	static Values<bool> unmask(const Mask in, const Eigen::Index count)
+	{
+		Values<bool> flags {1, count};
+
+		for (Eigen::Index i = 0; i < count; i++)
+			flags(i) = (in & ContactFrame::bit(i)) != 0;
+
+		return flags;
+	}
+
+private:
+	/*!
+	 * Sets or clears the bits of a mask.
+	 *
+	 * @param[in] mask The mask to change.
+	 * @param[in] bits The bits to change.
+	 * @param[in] value Whether the bits are set or cleared.
+	 * @return The changed mask.
+	 */
+	static constexpr Mask assign(const Mask mask, const Mask bits, const bool value)
+	{
+		return value ? (mask | bits) : (mask & ~bits);
+	}
+};
+
+} // namespace iptsd::contacts
+
+#endif // IPTSD_CONTACTS_FRAME_HPP
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_HISTORY_HPP
+#define IPTSD_CONTACTS_HISTORY_HPP
+
+#include "contact.hpp"
+
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::contacts {
+
+/*!
+ * Stores the contacts of the last frames, so that they can be looked up by their index.
+ *
+ * The frames are stored in a ring buffer with a fixed number of entries. For every entry,
+ * a table maps the index of a contact to its position in the frame. All buffers only grow,
+ * so that no memory is allocated once the largest number of contacts has been seen.
+ */
+template <class T>
+class History {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+private:
+	// Marks an index that is not part of a frame.
+	static constexpr usize NONE = std::numeric_limits<usize>::max();
+
+	struct Entry {
+	public:
+		// The contacts of the frame.
+		std::vector<Contact<T>> contacts {};
+
+		// The position of every contact index in the list of contacts.
+		std::vector<usize> slots {};
+	};
+
+private:
+	// The stored frames.
+	std::vector<Entry> m_entries;
+
+	// The entry of the most recent frame.
+	usize m_head = 0;
+
+public:
+	/*!
+	 * Creates a new, empty history.
+	 *
+	 * @param[in] size How many frames are kept.
+	 */
+	History(const usize size) : m_entries(std::max<usize>(size, 1)) {};
+
+	/*!
+	 * How many frames are kept.
+	 *
+	 * @return The number of stored frames.
+	 */
+	[[nodiscard]] usize size() const
+	{
+		return m_entries.size();
+	}
+
+	/*!
+	 * Forgets all stored frames.
+	 */
+	void reset()
+	{
+		for (Entry &entry : m_entries) {
+			entry.contacts.clear();
+			std::fill(entry.slots.begin(), entry.slots.end(), NONE);
+		}
+	}
+
+	/*!
+	 * Adds a frame to the history, replacing the oldest stored frame.
+	 *
+	 * @param[in] frame The list of contacts of the new frame.
+	 */
+	void push(const std::vector<Contact<T>> &frame)
+	{
+		m_head = (m_head + 1) % m_entries.size();
+
+		Entry &entry = m_entries[m_head];
+
+		// Only remove the slots that were used by the replaced frame.
+		for (const Contact<T> &contact : entry.contacts) {
+			if (contact.index.has_value())
+				entry.slots[contact.index.value()] = NONE;
+		}
+
+		entry.contacts.assign(frame.begin(), frame.end());
+
+		for (usize i = 0; i < entry.contacts.size(); i++) {
+			const Contact<T> &contact = entry.contacts[i];
+
+			if (!contact.index.has_value())
+				continue;
+
+			const usize index = contact.index.value();
+
+			if (index >= entry.slots.size())
+				entry.slots.resize(index + 1, NONE);
+
+			entry.slots[index] = i;
+		}
+	}
+
+	/*!
+	 * Returns a stored frame.
+	 *
+	 * @param[in] age How many frames ago the frame was added. 0 is the most recent frame.
+	 * @return The list of contacts of that frame. Empty if there is no such frame.
+	 */
+	[[nodiscard]] const std::vector<Contact<T>> &frame(const usize age = 0) const
+	{
+		return this->entry(age).contacts;
+	}
+
+	/*!
+	 * Searches for a contact in a stored frame.
+	 *
+	 * @param[in] index The index of the contact.
+	 * @param[in] age How many frames ago the frame was added. 0 is the most recent frame.
+	 * @return A pointer to the contact, or nullptr if the frame doesn't contain it.
+	 */
+	[[nodiscard]] const Contact<T> *find(const usize index, const usize age = 0) const
+	{
+		const Entry &entry = this->entry(age);
+
+		if (index >= entry.slots.size())
+			return nullptr;
+
+		const usize slot = entry.slots[index];
+
+		if (slot == NONE)
+			return nullptr;
+
+		return &entry.contacts[slot];
+	}
+
+private:
+	/*!
+	 * Returns the entry of a stored frame.
+	 *
+	 * @param[in] age How many frames ago the frame was added. Must be smaller than the size.
+	 * @return The entry of that frame.
+	 */
+	[[nodiscard]] const Entry &entry(const usize age) const
+	{
+		const usize size = m_entries.size();
+		return m_entries[(m_head + size - (age % size)) % size];
+	}
+};
+
+} // namespace iptsd::contacts
+
+#endif // IPTSD_CONTACTS_HISTORY_HPP
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_PREDICTION_CONFIG_HPP
+#define IPTSD_CONTACTS_PREDICTION_CONFIG_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <type_traits>
+
+namespace iptsd::contacts::prediction {
+
+template <class T>
+struct Config {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+public:
+	/*
+	 * Whether the movement of contacts is predicted.
+	 * The predicted positions are used for matching contacts between two frames.
+	 */
+	bool enable = false;
+
+	/*
+	 * How many frames into the future the position of a contact is extrapolated.
+	 * If set to 0, the measured position is not changed.
+	 */
+	T horizon = casts::to<T>(0);
+
+	/*
+	 * The standard deviation of the measured position of a contact.
+	 * The default values assume that the contact positions are normalized.
+	 */
+	T measurement_noise = casts::to<T>(0.001);
+
+	/*
+	 * The standard deviation of the change of velocity of a contact between two frames.
+	 */
+	T acceleration_noise = casts::to<T>(0.002);
+
+	/*
+	 * If the area of a contact shrinks below this fraction of its area in the last frame,
+	 * it is assumed to be lifting off, and its position is not extrapolated.
+	 */
+	T lift_ratio = casts::to<T>(0.95);
+};
+
+} // namespace iptsd::contacts::prediction
+
+#endif // IPTSD_CONTACTS_PREDICTION_CONFIG_HPP
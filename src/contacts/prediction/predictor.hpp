@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_PREDICTION_PREDICTOR_HPP
+#define IPTSD_CONTACTS_PREDICTION_PREDICTOR_HPP
+
+#include "../contact.hpp"
+#include "config.hpp"
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <type_traits>
+#include <vector>
+
+namespace iptsd::contacts::prediction {
+
+template <class T>
+class Predictor {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+private:
+	/*
+	 * The state of the kalman filter of a single contact.
+	 *
+	 * Both axes are filtered independently with the same constant velocity model. Since they
+	 * share the same noise parameters and are updated at the same time, their covariance
+	 * matrices are identical and only stored once.
+	 */
+	struct State {
+	public:
+		// The estimated position of the contact.
+		Vector2<T> position = Vector2<T>::Zero();
+
+		// The estimated velocity of the contact, in units per frame.
+		Vector2<T> velocity = Vector2<T>::Zero();
+
+		// The covariance of position and velocity.
+		Matrix2<T> covariance = Matrix2<T>::Zero();
+
+		// The area of the contact in the last frame.
+		T area = casts::to<T>(0);
+
+		// Whether the contact got smaller in the last frame, because it is lifting off.
+		bool lifting = false;
+
+		// The number of the frame the contact was seen in last.
+		usize frame = 0;
+
+		// For how many consecutive frames the contact has been seen.
+		usize observations = 0;
+	};
+
+private:
+	Config<T> m_config;
+
+	// The filter states, indexed by the index of the contacts.
+	std::vector<State> m_states {};
+
+	// The contacts from the last frame, at the position where they are expected next.
+	std::vector<Contact<T>> m_expected {};
+
+	// The number of the current frame.
+	usize m_frame = 0;
+
+public:
+	Predictor(Config<T> config) : m_config {std::move(config)} {};
+
+	/*!
+	 * Resets the predictor by forgetting the movement of all contacts.
+	 */
+	void reset()
+	{
+		m_states.clear();
+		m_expected.clear();
+	}
+
+	/*!
+	 * Whether the movement of contacts is predicted.
+	 *
+	 * @return Whether the predictor is enabled.
+	 */
+	[[nodiscard]] bool enabled() const
+	{
+		return m_config.enable;
+	}
+
+	/*!
+	 * The contacts from the last frame, moved to where they are expected in the next frame.
+	 *
+	 * @return The list of expected contacts.
+	 */
+	[[nodiscard]] const std::vector<Contact<T>> &expected() const
+	{
+		return m_expected;
+	}
+
+	/*!
+	 * Updates the movement of all contacts from a frame and predicts their next position.
+	 *
+	 * The contacts themselves are not changed, see @ref extrapolate for that.
+	 *
+	 * @param[in] frame The list of tracked contacts, at their measured position.
+	 */
+	void predict(const std::vector<Contact<T>> &frame)
+	{
+		if (!m_config.enable)
+			return;
+
+		m_frame++;
+		m_expected.clear();
+
+		for (const Contact<T> &contact : frame) {
+			// Contacts that can't be tracked can't be predicted.
+			if (!contact.index.has_value())
+				continue;
+
+			const usize index = contact.index.value();
+
+			if (index >= m_states.size())
+				m_states.resize(index + 1);
+
+			State &state = m_states[index];
+			this->update(state, contact);
+
+			m_expected.push_back(contact);
+			m_expected.back().mean = state.position + state.velocity;
+
+			// Contacts get smaller while they are lifted off.
+			const T area = contact.size.prod();
+
+			state.lifting = area < state.area * m_config.lift_ratio;
+			state.area = area;
+		}
+	}
+
+	/*!
+	 * Moves contacts along their predicted movement, by the configured horizon.
+	 *
+	 * This only changes the reported position, and has to run after the contacts were
+	 * stabilized and validated. The filter and the stored history keep the measured positions.
+	 *
+	 * @param[in,out] frame The list of contacts that were passed to @ref predict.
+	 */
+	void extrapolate(std::vector<Contact<T>> &frame) const
+	{
+		if (!m_config.enable || m_config.horizon <= 0)
+			return;
+
+		for (Contact<T> &contact : frame) {
+			if (!contact.index.has_value())
+				continue;
+
+			const usize index = contact.index.value();
+
+			if (index >= m_states.size())
+				continue;
+
+			const State &state = m_states[index];
+
+			if (this->can_extrapolate(state, contact))
+				contact.mean += state.velocity * m_config.horizon;
+		}
+	}
+
+private:
+	/*!
+	 * Runs the kalman filter of a contact with the measured position.
+	 *
+	 * @param[in,out] state The filter state of the contact.
+	 * @param[in] contact The contact.
+	 */
+	void update(State &state, const Contact<T> &contact) const
+	{
+		const T r = m_config.measurement_noise * m_config.measurement_noise;
+		const T q = m_config.acceleration_noise * m_config.acceleration_noise;
+
+		const Vector2<T> &z = contact.mean;
+
+		// If the contact was not seen in the last frame, it is a new one.
+		if (state.observations == 0 || state.frame + 1 != m_frame) {
+			state.position = z;
+			state.velocity = Vector2<T>::Zero();
+			state.frame = m_frame;
+			state.observations = 1;
+			return;
+		}
+
+		state.frame = m_frame;
+		state.observations++;
+
+		// The velocity is unknown until the contact was seen twice.
+		if (state.observations == 2) {
+			state.velocity = z - state.position;
+			state.position = z;
+			state.covariance << r, r, r, 2 * r;
+			return;
+		}
+
+		Matrix2<T> &p = state.covariance;
+
+		// Predict: Move by one frame with constant velocity
+		state.position += state.velocity;
+
+		const T p00 = p(0, 0) + 2 * p(0, 1) + p(1, 1) + q / 4;
+		const T p01 = p(0, 1) + p(1, 1) + q / 2;
+		const T p11 = p(1, 1) + q;
+
+		// Update: Correct the prediction with the measured position
+		const T s = p00 + r;
+		const T k0 = p00 / s;
+		const T k1 = p01 / s;
+
+		const Vector2<T> innovation = z - state.position;
+
+		state.position += k0 * innovation;
+		state.velocity += k1 * innovation;
+
+		p(0, 0) = (1 - k0) * p00;
+		p(0, 1) = (1 - k0) * p01;
+		p(1, 0) = p(0, 1);
+		p(1, 1) = p11 - k1 * p01;
+	}
+
+	/*!
+	 * Checks if the position of a contact can be extrapolated.
+	 *
+	 * @param[in] state The filter state of the contact.
+	 * @param[in] contact The validated contact.
+	 * @return Whether the velocity of the contact is known, it is valid and not lifting off.
+	 */
+	[[nodiscard]] bool can_extrapolate(const State &state, const Contact<T> &contact) const
+	{
+		// The state belongs to an older contact that had the same index.
+		if (state.frame != m_frame)
+			return false;
+
+		if (state.observations < 2)
+			return false;
+
+		if (!contact.valid.value_or(true))
+			return false;
+
+		return !state.lifting;
+	}
+};
+
+} // namespace iptsd::contacts::prediction
+
+#endif // IPTSD_CONTACTS_PREDICTION_PREDICTOR_HPP
@@ -3,6 +3,7 @@
 #ifndef IPTSD_CONTACTS_STABILITY_CONFIG_HPP
 #define IPTSD_CONTACTS_STABILITY_CONFIG_HPP
 
+#include <common/casts.hpp>
 #include <common/types.hpp>
 
 #include <optional>
@@ -31,6 +32,37 @@ public:
 	 * exceed.
 	 */
 	std::optional<Vector2<T>> orientation_threshold = std::nullopt;
+
+	/*
+	 * The parameters of the adaptive smoothing filter for the position of a contact.
+	 *
+	 * x is the cutoff frequency for a contact that is not moving, in cycles per frame.
+	 * y is how much the cutoff frequency increases with the speed of the contact.
+	 * A lower cutoff frequency removes more jitter, but adds more latency.
+	 */
+	std::optional<Vector2<T>> position_smoothing = std::nullopt;
+
+	/*
+	 * The parameters of the adaptive smoothing filter for the size of a contact.
+	 */
+	std::optional<Vector2<T>> size_smoothing = std::nullopt;
+
+	/*
+	 * The parameters of the adaptive smoothing filter for the orientation of a contact.
+	 */
+	std::optional<Vector2<T>> orientation_smoothing = std::nullopt;
+
+	/*
+	 * The cutoff frequency for estimating the speed of a contact, in cycles per frame.
+	 */
+	T smoothing_derivative_cutoff = casts::to<T>(0.1);
+
+	/*
+	 * The physical size of the area that the positions of the contacts are normalized to.
+	 * The speed of the position is measured in this unit, so that the smoothing reacts
+	 * equally to movements in all directions, even if the area is not square.
+	 */
+	Vector2<T> scale = Vector2<T>::Ones();
 };
 
 } // namespace iptsd::contacts::stability
@@ -4,6 +4,8 @@
 #define IPTSD_CONTACTS_STABILITY_STABILIZER_HPP
 
 #include "../contact.hpp"
+#include "../frame.hpp"
+#include "../history.hpp"
 #include "config.hpp"
 
 #include <common/casts.hpp>
@@ -11,10 +13,7 @@
 
 #include <gsl/gsl>
 
-#include <algorithm>
-#include <iterator>
 #include <type_traits>
-#include <vector>
 
 namespace iptsd::contacts::stability {
 
@@ -23,85 +22,245 @@ class Stabilizer {
 public:
 	static_assert(std::is_floating_point_v<T>);
 
+private:
+	using Frame = ContactFrame<T>;
+	using Mask = typename Frame::Mask;
+
+	template <class U>
+	using Values = typename Frame::template Values<U>;
+
+	template <class U>
+	using Vectors = typename Frame::template Vectors<U>;
+
+	// How many contacts can be smoothed. Tracking never assigns more indices than this.
+	static constexpr Eigen::Index SLOTS = Frame::CAPACITY * 2;
+
+	// Position (x, y), size (x, y) and orientation of a contact.
+	static constexpr Eigen::Index CHANNELS = 5;
+
+	// The values of all smoothed channels for every contact of a frame.
+	using Samples =
+		Eigen::Array<T, CHANNELS, Eigen::Dynamic, Eigen::ColMajor, CHANNELS, Frame::CAPACITY>;
+
 private:
 	Config<T> m_config;
 
-	// The last frame.
-	std::vector<Contact<T>> m_last {};
+	// The contacts from the last frame, at the same position as in the current frame.
+	Frame m_last {};
+
+	// The smoothed values of every contact, indexed by the index of the contact.
+	Eigen::Array<T, CHANNELS, SLOTS> m_filtered = Eigen::Array<T, CHANNELS, SLOTS>::Zero();
+
+	// The smoothed rate of change of every contact, indexed by the index of the contact.
+	Eigen::Array<T, CHANNELS, SLOTS> m_derivative = Eigen::Array<T, CHANNELS, SLOTS>::Zero();
+
+	// The cutoff frequency of every channel for contacts that are not changing.
+	Eigen::Array<T, CHANNELS, 1> m_min_cutoff = Eigen::Array<T, CHANNELS, 1>::Zero();
+
+	// How much the cutoff frequency of every channel increases with the rate of change.
+	Eigen::Array<T, CHANNELS, 1> m_beta = Eigen::Array<T, CHANNELS, 1>::Zero();
 
 public:
-	Stabilizer(Config<T> config) : m_config {std::move(config)} {};
+	Stabilizer(Config<T> config) : m_config {std::move(config)}
+	{
+		const Vector2<T> position = m_config.position_smoothing.value_or(Vector2<T>::Zero());
+		const Vector2<T> size = m_config.size_smoothing.value_or(Vector2<T>::Zero());
+		const Vector2<T> orientation =
+			m_config.orientation_smoothing.value_or(Vector2<T>::Zero());
+
+		m_min_cutoff << position.x(), position.x(), size.x(), size.x(), orientation.x();
+		m_beta << position.y(), position.y(), size.y(), size.y(), orientation.y();
+	};
 
 	/*!
-	 * Resets the stabilizer by clearing the stored previous frames.
+	 * Stabilizes all contacts of a frame.
+	 *
+	 * All contacts are processed at once. If enabled, the contacts are smoothed first.
+	 * Every change is compared against the same contact from the last frame. Changes that
+	 * are too small are discarded, and contacts with changes that are too large are marked
+	 * as unstable.
+	 *
+	 * @param[in,out] frame The contacts to stabilize.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void reset()
+	void stabilize(Frame &frame, const History<T> &history)
 	{
-		m_last.clear();
+		// Contacts that can't be tracked can't be stabilized.
+		frame.has_stable |= frame.has_index;
+		frame.stable |= frame.has_index;
+
+		const Mask found = this->gather(frame, history);
+
+		const bool smoothing = m_config.position_smoothing.has_value() ||
+		                       m_config.size_smoothing.has_value() ||
+		                       m_config.orientation_smoothing.has_value();
+
+		if (smoothing)
+			this->smooth(frame, found);
+
+		if (found == 0)
+			return;
+
+		const Values<bool> mask = Frame::unmask(found, frame.count);
+
+		Mask unstable = 0;
+
+		if (m_config.size_threshold.has_value())
+			unstable |= this->stabilize_size(frame, mask);
+
+		if (m_config.position_threshold.has_value())
+			unstable |= this->stabilize_position(frame, mask);
+
+		if (m_config.orientation_threshold.has_value())
+			unstable |= this->stabilize_orientation(frame, mask);
+
+		frame.stable &= ~unstable;
 	}
 
+private:
 	/*!
-	 * Stabilizes all contacts of a frame.
+	 * Copies the contacts of the last frame to the same position as in the current frame.
 	 *
-	 * @param[in,out] frame The list of contacts to stabilize.
+	 * @param[in] frame The contacts of the current frame.
+	 * @param[in] history The contacts from the previous frames.
+	 * @return The contacts that are also present in the last frame.
 	 */
-	void stabilize(std::vector<Contact<T>> &frame)
+	Mask gather(const Frame &frame, const History<T> &history)
 	{
-		// Stabilize contacts
-		for (Contact<T> &contact : frame)
-			this->stabilize_contact(contact);
+		Mask found = 0;
 
-		m_last.clear();
+		m_last.count = frame.count;
 
-		// Save a copy of the new data
-		std::copy(frame.begin(), frame.end(), std::back_inserter(m_last));
+		for (Eigen::Index i = 0; i < frame.count; i++) {
+			if ((frame.has_index & Frame::bit(i)) == 0)
+				continue;
+
+			const Contact<T> *last = history.find(frame.indices[casts::to_unsigned(i)]);
+
+			if (last == nullptr)
+				continue;
+
+			m_last.set(i, *last);
+			found |= Frame::bit(i);
+		}
+
+		return found;
 	}
 
-private:
 	/*!
-	 * Stabilize a single contact.
+	 * Smoothes position, size and orientation of the contacts with a One Euro filter.
 	 *
-	 * @param[in,out] contact The contact to stabilize.
+	 * This is a low-pass filter whose cutoff frequency increases with the rate of change.
+	 * Slow movements are smoothed a lot, to remove jitter, while fast movements are smoothed
+	 * very little, to keep the latency low. Every tracked contact has its own filter state.
+	 *
+	 * @param[in,out] frame The contacts to smooth.
+	 * @param[in] found The contacts that are also present in the last frame.
 	 */
-	void stabilize_contact(Contact<T> &contact) const
+	void smooth(Frame &frame, const Mask found)
 	{
-		// Contacts that can't be tracked can't be stabilized.
-		if (!contact.index.has_value())
-			return;
+		const Eigen::Index n = frame.count;
 
-		contact.stable = true;
+		const T max = frame.normalized ? casts::to<T>(1) : gsl::narrow_cast<T>(M_PI);
 
-		const usize index = contact.index.value();
-		const auto wrapper = Contact<T>::find_in_frame(index, m_last);
+		Samples raw {CHANNELS, n};
+		Samples filtered {CHANNELS, n};
+		Samples derivative {CHANNELS, n};
 
-		if (!wrapper.has_value())
-			return;
+		raw.topRows(2) = frame.means.leftCols(n);
+		raw.middleRows(2, 2) = frame.sizes.leftCols(n);
+		raw.row(4) = frame.orientations.leftCols(n);
 
-		const Contact<T> &last = wrapper.value();
+		// Load the filter state of all contacts that were present in the last frame.
+		for (Eigen::Index i = 0; i < n; i++) {
+			const Eigen::Index slot = casts::to_eigen(frame.indices[casts::to_unsigned(i)]);
 
-		if (m_config.size_threshold.has_value())
-			this->stabilize_size(contact, last);
+			if ((found & Frame::bit(i)) != 0 && slot < SLOTS) {
+				filtered.col(i) = m_filtered.col(slot);
+				derivative.col(i) = m_derivative.col(slot);
+			} else {
+				filtered.col(i) = raw.col(i);
+				derivative.col(i).setZero();
+			}
+		}
 
-		if (m_config.position_threshold.has_value())
-			this->stabilize_position(contact, last);
+		Samples delta = raw - filtered;
 
-		if (m_config.orientation_threshold.has_value())
-			this->stabilize_orientation(contact, last);
+		// The orientation wraps around, take the shorter way.
+		delta.row(4) -= max * (delta.row(4) / max).round();
+
+		// Measure the speed of the position in the same unit along both axes.
+		Samples change = delta;
+		change.topRows(2).colwise() *= m_config.scale.array();
+
+		const T ad = Stabilizer::alpha(m_config.smoothing_derivative_cutoff);
+		derivative += ad * (change - derivative);
+
+		Samples speed = derivative.abs();
+
+		// Both axes of the position use the speed of the contact.
+		speed.topRows(2) = derivative.topRows(2).square().colwise().sum().sqrt().replicate(2, 1);
+
+		const T one = casts::to<T>(1);
+		const T tau = 2 * gsl::narrow_cast<T>(M_PI);
+
+		const Samples cutoff = m_min_cutoff.replicate(1, n) + m_beta.replicate(1, n) * speed;
+		const Samples alpha = one / (one + one / (tau * cutoff));
+
+		filtered += alpha * delta;
+		filtered.row(4) -= max * (filtered.row(4) / max).floor();
+
+		// Store the new filter state.
+		for (Eigen::Index i = 0; i < n; i++) {
+			if ((frame.has_index & Frame::bit(i)) == 0)
+				continue;
+
+			const Eigen::Index slot = casts::to_eigen(frame.indices[casts::to_unsigned(i)]);
+
+			if (slot >= SLOTS)
+				continue;
+
+			m_filtered.col(slot) = filtered.col(i);
+			m_derivative.col(slot) = derivative.col(i);
+		}
+
+		if (m_config.position_smoothing.has_value())
+			frame.means.leftCols(n) = filtered.topRows(2);
+
+		if (m_config.size_smoothing.has_value())
+			frame.sizes.leftCols(n) = filtered.middleRows(2, 2);
+
+		if (m_config.orientation_smoothing.has_value())
+			frame.orientations.leftCols(n) = filtered.row(4);
 	}
 
 	/*!
-	 * Stabilizes the size of the contact.
+	 * Calculates the smoothing factor of a low-pass filter with a sample interval of one frame.
 	 *
-	 * @param[in,out] current The contact to stabilize.
-	 * @param[in] last The contact to compare against.
+	 * @param[in] cutoff The cutoff frequency, in cycles per frame.
+	 * @return How much of the change is applied to the filtered value.
 	 */
-	void stabilize_size(Contact<T> &current, const Contact<T> &last) const
+	static T alpha(const T cutoff)
 	{
-		if (!m_config.size_threshold.has_value())
-			return;
+		return 1 / (1 + 1 / (2 * gsl::narrow_cast<T>(M_PI) * cutoff));
+	}
 
+	/*!
+	 * Stabilizes the size of the contacts.
+	 *
+	 * @param[in,out] frame The contacts to stabilize.
+	 * @param[in] found The contacts that are also present in the last frame.
+	 * @return The contacts that are unstable.
+	 */
+	Mask stabilize_size(Frame &frame, const Values<bool> &found) const
+	{
 		const Vector2<T> thresh = m_config.size_threshold.value();
-		const Vector2<T> delta = (current.size - last.size).cwiseAbs();
+		const Eigen::Index n = frame.count;
+
+		auto current = frame.sizes.leftCols(n);
+		const auto last = m_last.sizes.leftCols(n);
+
+		const Vectors<T> delta = (current - last).abs();
 
 		/*
 		 * If the size is increasing too slow, discard the change.
@@ -109,32 +268,28 @@ private:
 		 * Otherwise, don't change the size.
 		 */
 
-		if (delta.x() < thresh.x())
-			current.size.x() = last.size.x();
-		else if (delta.x() > thresh.y())
-			current.stable = false;
+		const Vectors<bool> slow = (delta < thresh.x()) && found.replicate(2, 1);
+		current = slow.select(last, current);
 
-		if (delta.y() < thresh.x())
-			current.size.y() = last.size.y();
-		else if (delta.y() > thresh.y())
-			current.stable = false;
+		return Frame::mask((delta > thresh.y()).colwise().any() && found);
 	}
 
 	/*!
-	 * Stabilizes the position of the contact.
+	 * Stabilizes the position of the contacts.
 	 *
-	 * @param[in,out] current The contact to stabilize.
-	 * @param[in] last The contact to compare against.
+	 * @param[in,out] frame The contacts to stabilize.
+	 * @param[in] found The contacts that are also present in the last frame.
+	 * @return The contacts that are unstable.
 	 */
-	void stabilize_position(Contact<T> &current, const Contact<T> &last) const
+	Mask stabilize_position(Frame &frame, const Values<bool> &found) const
 	{
-		if (!m_config.position_threshold.has_value())
-			return;
-
 		const Vector2<T> thresh = m_config.position_threshold.value();
+		const Eigen::Index n = frame.count;
 
-		const Vector2<T> delta = current.mean - last.mean;
-		const T distance = std::hypot(delta.x(), delta.y());
+		auto current = frame.means.leftCols(n);
+		const auto last = m_last.means.leftCols(n);
+
+		const Values<T> distance = (current - last).square().colwise().sum().sqrt();
 
 		/*
 		 * If the contact is moving too slow, discard the position change.
@@ -142,18 +297,30 @@ private:
 		 * Otherwise, don't change the position.
 		 */
 
-		if (distance < thresh.x())
-			current.mean = last.mean;
-		else if (distance > thresh.y())
-			current.stable = false;
+		const Values<bool> slow = (distance < thresh.x()) && found;
+		current = slow.replicate(2, 1).select(last, current);
+
+		return Frame::mask((distance > thresh.y()) && found);
 	}
 
-	void stabilize_orientation(Contact<T> &current, const Contact<T> &last) const
+	/*!
+	 * Stabilizes the orientation of the contacts.
+	 *
+	 * @param[in,out] frame The contacts to stabilize.
+	 * @param[in] found The contacts that are also present in the last frame.
+	 * @return The contacts that are unstable.
+	 */
+	Mask stabilize_orientation(Frame &frame, const Values<bool> &found) const
 	{
-		if (!m_config.orientation_threshold.has_value())
-			return;
+		const Vector2<T> thresh = m_config.orientation_threshold.value();
+		const Eigen::Index n = frame.count;
+
+		const auto sizes = frame.sizes.leftCols(n);
 
-		const T aspect = current.size.maxCoeff() / current.size.minCoeff();
+		auto current = frame.orientations.leftCols(n);
+		const auto last = m_last.orientations.leftCols(n);
+
+		const Values<T> aspect = sizes.colwise().maxCoeff() / sizes.colwise().minCoeff();
 
 		/*
 		 * If the aspect ratio is too small, the orientation cannot be determined
@@ -162,21 +329,17 @@ private:
 		 * TODO: Check if there is a better way to signal this (make orientation optional,
 		 * and / or applying the last stable value).
 		 */
-		if (aspect < 1.1) {
-			current.orientation = 0;
-			return;
-		}
-
-		const Vector2<T> thresh = m_config.orientation_threshold.value();
+		const Values<bool> round = (aspect < casts::to<T>(1.1)) && found;
+		const Values<bool> oriented = !round && found;
 
-		const T max = current.normalized ? casts::to<T>(1) : gsl::narrow_cast<T>(M_PI);
+		const T max = frame.normalized ? casts::to<T>(1) : gsl::narrow_cast<T>(M_PI);
 
 		// The angle difference in both directions.
-		const T d1 = std::abs(current.orientation - last.orientation);
-		const T d2 = max - d1;
+		const Values<T> d1 = (current - last).abs();
+		const Values<T> d2 = max - d1;
 
 		// Pick the smaller difference to properly handle going from 0° to 179°.
-		const T delta = std::min(d1, d2);
+		const Values<T> delta = d1.min(d2);
 
 		/*
 		 * If the angle is changing too slow, discard the orientation change.
@@ -184,10 +347,12 @@ private:
 		 * Otherwise, don't change the orientation.
 		 */
 
-		if (delta < thresh.x())
-			current.orientation = last.orientation;
-		else if (delta > thresh.y())
-			current.stable = false;
+		const Values<bool> slow = (delta < thresh.x()) && oriented;
+
+		current = slow.select(last, current);
+		current = round.select(casts::to<T>(0), current);
+
+		return Frame::mask((delta > thresh.y()) && oriented);
 	}
 };
 
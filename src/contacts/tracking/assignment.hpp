@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_TRACKING_ASSIGNMENT_HPP
+#define IPTSD_CONTACTS_TRACKING_ASSIGNMENT_HPP
+
+#include <common/casts.hpp>
+#include <common/types.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace iptsd::contacts::tracking::assignment {
+
+/*!
+ * Temporary storage for finding an optimal assignment.
+ *
+ * All vectors only grow, so that no memory is allocated once the largest number of contacts
+ * has been seen.
+ */
+template <class T>
+struct Buffers {
+	// The potential of every row.
+	std::vector<T> u {};
+
+	// The potential of every column.
+	std::vector<T> v {};
+
+	// The smallest reduced cost of every column on the current augmenting path.
+	std::vector<T> minv {};
+
+	// The row that is assigned to every column (1-based, 0 is unassigned).
+	std::vector<usize> p {};
+
+	// The previous column on the augmenting path.
+	std::vector<usize> way {};
+
+	// Whether a column is part of the current augmenting path.
+	std::vector<bool> used {};
+};
+
+namespace impl {
+
+/*!
+ * Checks if a distance is small enough for the two contacts to be matched.
+ *
+ * @param[in] distance The distance between both contacts.
+ * @param[in] gate The maximum distance.
+ * @return Whether the contacts can be matched.
+ */
+template <class T>
+bool within(const T distance, const std::optional<T> &gate)
+{
+	return !gate.has_value() || distance <= gate.value();
+}
+
+/*!
+ * Matches every row with its closest column, if the matrix only has a single column or row.
+ *
+ * In this case, the closest pair is the optimal solution.
+ *
+ * @param[in] costs The distances between all pairs of rows and columns.
+ * @param[in] gate The maximum distance between two matched contacts.
+ * @param[out] matches The column that is matched with every row.
+ */
+template <class Derived>
+void single(const DenseBase<Derived> &costs,
+            const std::optional<typename DenseBase<Derived>::Scalar> &gate,
+            std::vector<std::optional<usize>> &matches)
+{
+	Eigen::Index y = 0;
+	Eigen::Index x = 0;
+
+	const auto min = costs.minCoeff(&y, &x);
+
+	if (within(min, gate))
+		matches[casts::to_unsigned(y)] = casts::to_unsigned(x);
+}
+
+} // namespace impl
+
+/*!
+ * Matches rows and columns by repeatedly taking the pair with the smallest distance.
+ *
+ * This is fast, but the result is not optimal. If two contacts are crossing each other,
+ * their indices can be swapped.
+ *
+ * @param[in,out] costs The distances between all pairs of rows and columns. Will be overwritten.
+ * @param[in] gate The maximum distance between two matched contacts.
+ * @param[out] matches The column that is matched with every row.
+ */
+template <class Derived>
+void greedy(DenseBase<Derived> &costs,
+            const std::optional<typename DenseBase<Derived>::Scalar> &gate,
+            std::vector<std::optional<usize>> &matches)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const Eigen::Index rows = costs.rows();
+	const Eigen::Index cols = costs.cols();
+
+	matches.assign(casts::to_unsigned(rows), std::nullopt);
+
+	for (Eigen::Index i = 0; i < std::min(rows, cols); i++) {
+		Eigen::Index y = 0;
+		Eigen::Index x = 0;
+
+		const T min = costs.minCoeff(&y, &x);
+
+		// All other pairs are even further apart.
+		if (!impl::within(min, gate))
+			break;
+
+		matches[casts::to_unsigned(y)] = casts::to_unsigned(x);
+
+		// Invalidate all entries containing these contacts
+		costs.derived().row(y) = Eigen::NumTraits<T>::infinity();
+		costs.derived().col(x) = Eigen::NumTraits<T>::infinity();
+	}
+}
+
+/*!
+ * Matches rows and columns so that the sum of the distances between all pairs is minimal.
+ *
+ * This uses the hungarian algorithm with shortest augmenting paths, which runs in O(n^3).
+ * The matrix is padded to a square matrix. Pairs that are further apart than the gate get
+ * the same cost as the padding, so that leaving contacts unmatched is preferred over
+ * matching contacts that are too far apart.
+ *
+ * If there is only a single row or column, the closest pair is taken directly.
+ *
+ * @param[in] costs The distances between all pairs of rows and columns. Must be finite.
+ * @param[in] gate The maximum distance between two matched contacts.
+ * @param[in] buffers Temporary storage.
+ * @param[out] matches The column that is matched with every row.
+ */
+template <class Derived>
+void optimal(const DenseBase<Derived> &costs,
+             const std::optional<typename DenseBase<Derived>::Scalar> &gate,
+             Buffers<typename DenseBase<Derived>::Scalar> &buffers,
+             std::vector<std::optional<usize>> &matches)
+{
+	using T = typename DenseBase<Derived>::Scalar;
+
+	const Eigen::Index rows = costs.rows();
+	const Eigen::Index cols = costs.cols();
+
+	matches.assign(casts::to_unsigned(rows), std::nullopt);
+
+	if (rows == 0 || cols == 0)
+		return;
+
+	if (rows == 1 || cols == 1) {
+		impl::single(costs, gate, matches);
+		return;
+	}
+
+	const T padding = gate.value_or(casts::to<T>(0));
+
+	const auto cost = [&](const usize y, const usize x) {
+		const Eigen::Index iy = casts::to_eigen(y);
+		const Eigen::Index ix = casts::to_eigen(x);
+
+		if (iy >= rows || ix >= cols)
+			return padding;
+
+		const T distance = costs(iy, ix);
+		return gate.has_value() ? std::min(distance, padding) : distance;
+	};
+
+	const usize n = casts::to_unsigned(std::max(rows, cols));
+	const T infinity = std::numeric_limits<T>::infinity();
+
+	// The buffers are 1-based, index 0 is a virtual column that starts every path.
+	buffers.u.assign(n + 1, casts::to<T>(0));
+	buffers.v.assign(n + 1, casts::to<T>(0));
+	buffers.p.assign(n + 1, 0);
+	buffers.way.assign(n + 1, 0);
+
+	std::vector<T> &u = buffers.u;
+	std::vector<T> &v = buffers.v;
+	std::vector<T> &minv = buffers.minv;
+	std::vector<usize> &p = buffers.p;
+	std::vector<usize> &way = buffers.way;
+	std::vector<bool> &used = buffers.used;
+
+	for (usize i = 1; i <= n; i++) {
+		p[0] = i;
+		usize j0 = 0;
+
+		minv.assign(n + 1, infinity);
+		used.assign(n + 1, false);
+
+		// Search for the shortest augmenting path that ends in an unassigned column.
+		do {
+			used[j0] = true;
+
+			const usize i0 = p[j0];
+
+			T delta = infinity;
+			usize j1 = 0;
+
+			for (usize j = 1; j <= n; j++) {
+				if (used[j])
+					continue;
+
+				const T reduced = cost(i0 - 1, j - 1) - u[i0] - v[j];
+
+				if (reduced < minv[j]) {
+					minv[j] = reduced;
+					way[j] = j0;
+				}
+
+				if (minv[j] < delta) {
+					delta = minv[j];
+					j1 = j;
+				}
+			}
+
+			for (usize j = 0; j <= n; j++) {
+				if (used[j]) {
+					u[p[j]] += delta;
+					v[j] -= delta;
+				} else {
+					minv[j] -= delta;
+				}
+			}
+
+			j0 = j1;
+		} while (p[j0] != 0);
+
+		// Flip the assignments along the path.
+		do {
+			const usize j1 = way[j0];
+
+			p[j0] = p[j1];
+			j0 = j1;
+		} while (j0 != 0);
+	}
+
+	for (usize j = 1; j <= n; j++) {
+		const usize y = p[j] - 1;
+		const usize x = j - 1;
+
+		if (y >= matches.size() || x >= casts::to_unsigned(cols))
+			continue;
+
+		if (!impl::within(costs(casts::to_eigen(y), casts::to_eigen(x)), gate))
+			continue;
+
+		matches[y] = x;
+	}
+}
+
+} // namespace iptsd::contacts::tracking::assignment
+
+#endif // IPTSD_CONTACTS_TRACKING_ASSIGNMENT_HPP
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CONTACTS_TRACKING_CONFIG_HPP
+#define IPTSD_CONTACTS_TRACKING_CONFIG_HPP
+
+#include <common/types.hpp>
+
+#include <optional>
+#include <type_traits>
+
+namespace iptsd::contacts::tracking {
+
+/*
+ * How contacts from the current frame are matched with contacts from the last frame.
+ */
+enum class Assignment : u8 {
+	// The closest pair of contacts is matched first, until no contacts are left.
+	GREEDY,
+
+	// The sum of the distances between all matched contacts is minimized.
+	OPTIMAL,
+};
+
+template <class T>
+struct Config {
+public:
+	static_assert(std::is_floating_point_v<T>);
+
+public:
+	/*
+	 * How contacts are matched between two frames.
+	 */
+	Assignment assignment = Assignment::OPTIMAL;
+
+	/*
+	 * The maximum distance a contact can travel between two frames.
+	 * Contacts that are further apart than this are never matched.
+	 */
+	std::optional<T> max_distance = std::nullopt;
+
+	/*
+	 * The physical size of the area that the positions of the contacts are normalized to.
+	 * The distances between contacts are measured in this unit, so that max_distance
+	 * applies equally in all directions, even if the area is not square.
+	 */
+	Vector2<T> scale = Vector2<T>::Ones();
+};
+
+} // namespace iptsd::contacts::tracking
+
+#endif // IPTSD_CONTACTS_TRACKING_CONFIG_HPP
@@ -20,11 +20,13 @@ namespace iptsd::contacts::tracking::distances {
  *
  * @param[in] x The first frame (x axis in the output).
  * @param[in] y The second frame (y axis in the output).
- * @param[out] out The output data.
+ * @param[in] scale The factors that the differences along both axes are multiplied with.
+ * @param[out] out The output data. Must have as many rows as y and as many columns as x.
  */
 template <class Derived>
 void calculate(const std::vector<Contact<typename DenseBase<Derived>::Scalar>> &x,
                const std::vector<Contact<typename DenseBase<Derived>::Scalar>> &y,
+               const Vector2<typename DenseBase<Derived>::Scalar> &scale,
                DenseBase<Derived> &out)
 {
 	using T = typename DenseBase<Derived>::Scalar;
@@ -32,8 +34,6 @@ void calculate(const std::vector<Contact<typename DenseBase<Derived>::Scalar>> &
 	const Eigen::Index sx = casts::to_eigen(x.size());
 	const Eigen::Index sy = casts::to_eigen(y.size());
 
-	out.derived().conservativeResize(sy, sx);
-
 	// Calculate the distances between current and previous inputs
 	for (Eigen::Index iy = 0; iy < sy; iy++) {
 		const Contact<T> &cy = y[casts::to_unsigned(iy)];
@@ -41,7 +41,8 @@ void calculate(const std::vector<Contact<typename DenseBase<Derived>::Scalar>> &
 		for (Eigen::Index ix = 0; ix < sx; ix++) {
 			const Contact<T> &cx = x[casts::to_unsigned(ix)];
 
-			out(iy, ix) = gsl::narrow_cast<T>((cx.mean - cy.mean).hypotNorm());
+			const Vector2<T> delta = (cx.mean - cy.mean).cwiseProduct(scale);
+			out(iy, ix) = gsl::narrow_cast<T>(delta.hypotNorm());
 		}
 	}
 }
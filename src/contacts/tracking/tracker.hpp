@@ -4,13 +4,16 @@
 #define IPTSD_CONTACTS_TRACKING_TRACKER_HPP
 
 #include "../contact.hpp"
+#include "../history.hpp"
+#include "assignment.hpp"
+#include "config.hpp"
 #include "distances.hpp"
 
 #include <common/casts.hpp>
 #include <common/types.hpp>
 
 #include <algorithm>
-#include <iterator>
+#include <optional>
 #include <vector>
 
 namespace iptsd::contacts::tracking {
@@ -21,77 +24,107 @@ public:
 	static_assert(std::is_floating_point_v<T>);
 
 private:
-	// The last frame.
-	std::vector<Contact<T>> m_last {};
+	Config<T> m_config;
 
 	// The distances between all contacts from the current and the last frame.
 	Image<T> m_distances {};
 
+	// The contact from the current frame that is matched with every contact from the last frame.
+	std::vector<std::optional<usize>> m_matches {};
+
+	// Temporary storage for the optimal assignment.
+	assignment::Buffers<T> m_buffers {};
+
 public:
+	Tracker(Config<T> config = {}) : m_config {std::move(config)} {};
+
 	/*!
-	 * Resets the tracker by clearing the stored copy of the last frame.
+	 * Runs the contact tracking algorithm over the contacts from the current frame.
+	 *
+	 * @param[in,out] frame The list of contacts that will be tracked.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void reset()
+	void track(std::vector<Contact<T>> &frame, const History<T> &history)
 	{
-		m_last.clear();
+		this->track(frame, history.frame(), history);
 	}
 
 	/*!
-	 * Runs the contact tracking algorithm over the contacts from the current frame.
+	 * Runs the contact tracking algorithm, using the expected positions of the last frame.
 	 *
 	 * @param[in,out] frame The list of contacts that will be tracked.
+	 * @param[in] expected The contacts from the last frame, at their expected position.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void track(std::vector<Contact<T>> &frame)
+	void track(std::vector<Contact<T>> &frame,
+	           const std::vector<Contact<T>> &expected,
+	           const History<T> &history)
 	{
 		usize counter = 0;
 
 		// Assign unique indices to all contacts of the current frame.
 		for (Contact<T> &contact : frame) {
-			contact.index = this->find_new_index(counter);
+			contact.index = Tracker::find_new_index(counter, history);
 			counter = contact.index.value() + 1;
 		}
 
-		if (!m_last.empty()) {
-			const usize min = std::min(frame.size(), m_last.size());
+		if (!expected.empty() && !frame.empty()) {
+			const Eigen::Index rows = casts::to_eigen(expected.size());
+			const Eigen::Index cols = casts::to_eigen(frame.size());
+
+			// The buffer only grows, so that it doesn't need to be reallocated every frame.
+			if (m_distances.rows() < rows || m_distances.cols() < cols) {
+				m_distances.conservativeResize(std::max(rows, m_distances.rows()),
+				                               std::max(cols, m_distances.cols()));
+			}
+
+			auto distances = m_distances.topLeftCorner(rows, cols);
 
 			// Calculate the distances between all contacts from the current and last
 			// frame
-			distances::calculate(frame, m_last, m_distances);
+			distances::calculate(frame, expected, m_config.scale, distances);
 
-			// Copy the old indices back for the amount of contacts that can be tracked.
-			for (usize i = 0; i < min; i++) {
-				Eigen::Index y = 0;
-				Eigen::Index x = 0;
+			this->assign(distances);
 
-				m_distances.minCoeff(&y, &x);
+			// Copy the old indices back for all contacts that could be tracked.
+			for (usize y = 0; y < m_matches.size(); y++) {
+				const std::optional<usize> &x = m_matches[y];
 
-				// Copy the index of the contact
-				frame[casts::to_unsigned(x)].index =
-					m_last[casts::to_unsigned(y)].index;
-
-				// Invalidate all entries containing these contacts
-				m_distances.row(y) = Eigen::NumTraits<T>::infinity();
-				m_distances.col(x) = Eigen::NumTraits<T>::infinity();
+				if (x.has_value())
+					frame[x.value()].index = expected[y].index;
 			}
-
-			m_last.clear();
 		}
-
-		// Save a copy of the new data
-		std::copy(frame.begin(), frame.end(), std::back_inserter(m_last));
 	}
 
 private:
+	/*!
+	 * Matches the contacts from the last frame with the contacts from the current frame.
+	 *
+	 * @param[in,out] distances The distances between all contacts. Can be overwritten.
+	 */
+	template <class Derived>
+	void assign(DenseBase<Derived> &distances)
+	{
+		const std::optional<T> &gate = m_config.max_distance;
+
+		// The optimal assignment can't handle contacts with broken positions.
+		if (m_config.assignment == Assignment::GREEDY || !distances.allFinite())
+			assignment::greedy(distances, gate, m_matches);
+		else
+			assignment::optimal(distances, gate, m_buffers, m_matches);
+	}
+
 	/*!
 	 * Searches for an index that is not already used by a contact from the last frame.
 	 *
 	 * @param[in] min The new index has to be at least this value.
+	 * @param[in] history The contacts from the previous frames.
 	 * @return A new unique index that was not used before.
 	 */
-	[[nodiscard]] usize find_new_index(usize min) const
+	[[nodiscard]] static usize find_new_index(usize min, const History<T> &history)
 	{
 		while (true) {
-			if (!Contact<T>::find_in_frame(min, m_last).has_value())
+			if (history.find(min) == nullptr)
 				return min;
 
 			min++;
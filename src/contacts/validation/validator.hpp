@@ -4,12 +4,14 @@
 #define IPTSD_CONTACTS_VALIDATION_VALIDATOR_HPP
 
 #include "../contact.hpp"
+#include "../frame.hpp"
+#include "../history.hpp"
 #include "config.hpp"
 
+#include <common/casts.hpp>
 #include <common/types.hpp>
 
 #include <type_traits>
-#include <vector>
 
 namespace iptsd::contacts::validation {
 
@@ -18,133 +20,117 @@ class Validator {
 public:
 	static_assert(std::is_floating_point_v<T>);
 
+private:
+	using Frame = ContactFrame<T>;
+	using Mask = typename Frame::Mask;
+
+	template <class U>
+	using Values = typename Frame::template Values<U>;
+
 private:
 	// The config for the validity checking phase.
 	Config<T> m_config;
 
-	// The last frame.
-	std::vector<Contact<T>> m_last {};
-
 public:
 	Validator(Config<T> config) : m_config {std::move(config)} {};
 
-	/*!
-	 * Resets the validator by clearing the stored copy of the last frame.
-	 */
-	void reset()
-	{
-		m_last.clear();
-	}
-
 	/*!
 	 * Checks the validity for all contacts of a frame.
 	 *
-	 * @param[in,out] frame The list of contacts to validate.
+	 * All contacts are checked at once. Contacts that were already marked as invalid
+	 * (e.g. by the detector) stay invalid.
+	 *
+	 * @param[in,out] frame The contacts to validate.
+	 * @param[in] history The contacts from the previous frames.
 	 */
-	void validate(std::vector<Contact<T>> &frame)
+	void validate(Frame &frame, const History<T> &history) const
 	{
-		for (Contact<T> &contact : frame)
-			contact.valid = this->check_contact(contact);
-
-		m_last.clear();
+		const Mask all = frame.all();
 
-		// Save a copy of the new data
-		std::copy(frame.begin(), frame.end(), std::back_inserter(m_last));
-	}
+		const Mask previous = frame.valid | ~frame.has_valid;
 
-private:
-	/*!
-	 * Checks a single contact.
-	 *
-	 * @param[in] contact The contact to check.
-	 * @return Whether the contact is valid.
-	 */
-	bool check_contact(const Contact<T> &contact)
-	{
 		// Don't invalidate unstable contacts
-		if (!contact.stable.value_or(true))
-			return true;
+		const Mask unstable = frame.has_stable & ~frame.stable;
+
+		Mask checks = all;
 
 		/*
 		 * If the state should be tracked and the contact was invalid in the
 		 * last frame, it is also invalid in the current frame.
 		 */
-		if (m_config.track_validity && !this->check_temporal(contact))
-			return false;
+		if (m_config.track_validity)
+			checks &= ~Validator::check_temporal(frame, history);
 
 		// Only do the size check if it is enabled
-		if (m_config.size_limits.has_value() && !this->check_size(contact))
-			return false;
+		if (m_config.size_limits.has_value())
+			checks &= this->check_size(frame);
 
 		// Only do the aspect check if it is enabled
-		if (m_config.aspect_limits.has_value() && !this->check_aspect(contact))
-			return false;
+		if (m_config.aspect_limits.has_value())
+			checks &= this->check_aspect(frame);
 
-		return true;
+		frame.valid = previous & (unstable | checks) & all;
+		frame.has_valid = all;
 	}
 
+private:
 	/*!
-	 * Checks the temporal validity of a contact.
+	 * Checks the temporal validity of all contacts.
+	 *
+	 * Contacts that can't be tracked are considered temporally valid.
 	 *
-	 * @param[in] contact The contact to check.
-	 * @return Whether the contact was valid in the last frame.
+	 * @param[in] frame The contacts to check.
+	 * @param[in] history The contacts from the previous frames.
+	 * @return The contacts that were invalid in the last frame.
 	 */
-	bool check_temporal(const Contact<T> &contact)
+	static Mask check_temporal(const Frame &frame, const History<T> &history)
 	{
-		// Contacts that can't be tracked are considered temporally valid.
-		if (!contact.index.has_value())
-			return true;
+		Mask invalid = 0;
 
-		const auto wrapper = Contact<T>::find_in_frame(contact.index.value(), m_last);
+		for (Eigen::Index i = 0; i < frame.count; i++) {
+			if ((frame.has_index & Frame::bit(i)) == 0)
+				continue;
 
-		if (!wrapper.has_value())
-			return true;
+			const Contact<T> *last = history.find(frame.indices[casts::to_unsigned(i)]);
 
-		const Contact<T> &last = wrapper.value();
+			if (last == nullptr)
+				continue;
 
-		if (!last.valid.has_value())
-			return true;
+			if (!last->valid.value_or(true))
+				invalid |= Frame::bit(i);
+		}
 
-		return last.valid.value();
+		return invalid;
 	}
 
 	/*!
-	 * Checks the size of a contact.
+	 * Checks the size of all contacts.
 	 *
-	 * @param[in] contact The contact to check.
-	 * @return Whether the size of the contact is within the valid range.
+	 * @param[in] frame The contacts to check.
+	 * @return The contacts whose size is within the valid range.
 	 */
-	bool check_size(const Contact<T> &contact)
+	[[nodiscard]] Mask check_size(const Frame &frame) const
 	{
-		if (!m_config.size_limits.has_value())
-			return true;
-
 		const Vector2<T> &limit = m_config.size_limits.value();
-		const Vector2<T> &size = contact.size;
+		const auto sizes = frame.sizes.leftCols(frame.count);
 
-		const T major = size.maxCoeff();
-		return major >= limit.minCoeff() && major <= limit.maxCoeff();
+		const Values<T> major = sizes.colwise().maxCoeff();
+		return Frame::mask(major >= limit.minCoeff() && major <= limit.maxCoeff());
 	}
 
 	/*!
-	 * Checks the aspect ratio of a contact.
+	 * Checks the aspect ratio of all contacts.
 	 *
-	 * @param[in] contact The contact to check.
-	 * @return Whether the aspect ratio of the contact is within the valid range.
+	 * @param[in] frame The contacts to check.
+	 * @return The contacts whose aspect ratio is within the valid range.
 	 */
-	bool check_aspect(const Contact<T> &contact)
+	[[nodiscard]] Mask check_aspect(const Frame &frame) const
 	{
-		if (!m_config.aspect_limits.has_value())
-			return true;
-
 		const Vector2<T> &limit = m_config.aspect_limits.value();
-		const Vector2<T> &size = contact.size;
-
-		const T major = size.maxCoeff();
-		const T minor = size.minCoeff();
+		const auto sizes = frame.sizes.leftCols(frame.count);
 
-		const T aspect = major / minor;
-		return aspect >= limit.minCoeff() && aspect <= limit.maxCoeff();
+		const Values<T> aspect = sizes.colwise().maxCoeff() / sizes.colwise().minCoeff();
+		return Frame::mask(aspect >= limit.minCoeff() && aspect <= limit.maxCoeff());
 	}
 };
 
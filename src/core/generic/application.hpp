@@ -7,6 +7,7 @@
 #include "device.hpp"
 #include "dft.hpp"
 #include "errors.hpp"
+#include "prediction.hpp"
 
 #include <common/casts.hpp>
 #include <common/error.hpp>
@@ -20,7 +21,10 @@
 
 #include <spdlog/spdlog.h>
 
-#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <utility>
 #include <vector>
 
 namespace iptsd::core {
@@ -32,13 +36,59 @@ namespace iptsd::core {
  * and contact detection from capacitive heatmaps.
  *
  * The final data can then be processed further by extending this
- * class and overriding the appropriate methods.
+ * class and hiding the appropriate methods. The methods of the derived
+ * class are called directly, without going through a virtual function,
+ * so the compiler can inline them into the processing code. They must be
+ * accessible from this class, i.e. public or befriending it.
+ *
+ * For applications that need to override the methods at runtime, see @ref Application.
  *
  * An application does not make any assumptions about the source
  * of the data it is receiving. For that reason, applications
  * need to be run by an application runner.
+ *
+ * @tparam Derived The application that extends this class.
  */
-class Application {
+template <class Derived>
+class StaticApplication {
+private:
+	/*
+	 * Passes the data from the parser to the processing functions of the application.
+	 */
+	struct Handler : public ipts::IgnoreSamples {
+	public:
+		StaticApplication &app;
+
+		explicit Handler(StaticApplication &application) : app {application} {};
+
+		void on_touch(const ipts::samples::Touch &data)
+		{
+			app.m_pending_touch.push_back(data);
+		}
+
+		void on_stylus(const ipts::samples::Stylus &data)
+		{
+			app.process_stylus(data);
+		}
+
+		void on_dft(const ipts::samples::DftWindow &data)
+		{
+			app.process_dft(data);
+		}
+
+		void on_button(const ipts::samples::Button &data)
+		{
+			app.process_button(data);
+		}
+	};
+
+private:
+	/*
+	 * Gaps between two heatmaps that are longer than this many frames are not counted
+	 * as missed frames. The device stops sending heatmaps while the stylus is in use.
+	 */
+	constexpr static f64 MAX_MISSED_FRAMES = 10;
+
 protected:
 	/*
 	 * The configuration for this application.
@@ -54,10 +104,15 @@ protected:
 	 */
 	DeviceInfo m_info;
 
+	/*
+	 * Receives the heatmap, stylus and DFT data from the parser.
+	 */
+	Handler m_handler {*this};
+
 	/*
 	 * Parses incoming data and returns heatmap, stylus and DFT data.
 	 */
-	ipts::Parser m_parser {};
+	ipts::Parser<Handler> m_parser {m_handler};
 
 	/*
 	 * Temporary storage for normalized heatmap data.
@@ -77,6 +132,11 @@ protected:
 	 */
 	std::vector<contacts::Contact<f64>> m_contacts {};
 
+	/*
+	 * Whether a warning about dropped contacts was already logged.
+	 */
+	bool m_warned_dropped = false;
+
 	/*
 	 * Newer devices use a DFT based stylus interface. Instead of sending already processed
 	 * coordinates, these devices send antenna measurements that requires interpolating
@@ -84,23 +144,110 @@ protected:
 	 */
 	DftStylus m_dft;
 
+	/*
+	 * Extrapolates the position of the stylus, to reduce the perceived latency.
+	 */
+	StylusPredictor m_stylus_predictor;
+
+	/*
+	 * Whether contact detection is skipped for heatmaps that are too weak to contain contacts.
+	 * Applications that need the normalized heatmap of every frame have to disable this.
+	 */
+	bool m_skip_idle_frames = true;
+
+	/*
+	 * How many heatmaps skipped contact detection because they could not contain contacts.
+	 */
+	usize m_idle_frames = 0;
+
+	/*
+	 * A copy of the last heatmap, for detecting if the same heatmap is sent again.
+	 */
+	std::vector<u8> m_last_heatmap {};
+
+	/*
+	 * The metadata of the last heatmap. The heatmap points to m_last_heatmap.
+	 */
+	ipts::samples::Touch m_last_touch {};
+
+	/*
+	 * How many heatmaps were identical to the previous one, and reused its contacts.
+	 */
+	usize m_duplicate_frames = 0;
+
+	/*
+	 * How many heatmaps were different from the previous one.
+	 */
+	usize m_unique_frames = 0;
+
+	/*
+	 * Whether the application uses the contacts. If not, contact detection is suspended.
+	 */
+	bool m_touch_demand = true;
+
+	/*
+	 * How many heatmaps skipped contact detection because the contacts were not needed.
+	 */
+	usize m_suspended_frames = 0;
+
+	/*
+	 * The heatmaps of the report that is currently being parsed.
+	 *
+	 * Contact detection is deferred until the whole report was parsed, so that
+	 * it can't delay the stylus data that was sent together with the heatmap.
+	 * The heatmaps point into the buffer of the report.
+	 */
+	std::vector<ipts::samples::Touch> m_pending_touch {};
+
+	/*
+	 * The time at which the data that is currently processed was captured by the device.
+	 *
+	 * The time is in microseconds and wraps around, just like MSC_TIMESTAMP on linux.
+	 * It is derived from the timestamps in the report headers and starts at zero.
+	 */
+	u32 m_timestamp = 0;
+
+private:
+	/*
+	 * The report timestamp that was used to update m_timestamp.
+	 */
+	std::optional<u16> m_last_timestamp = std::nullopt;
+
+	/*
+	 * The report timestamp of the last heatmap.
+	 */
+	std::optional<u16> m_last_frame = std::nullopt;
+
+	/*
+	 * The average time between two heatmaps, in units of 100μs.
+	 */
+	f64 m_frame_interval = 0;
+
+	/*
+	 * How many heatmaps were lost, based on the gaps between their timestamps.
+	 */
+	usize m_missed_frames = 0;
+
 public:
-	Application(const Config &config, const DeviceInfo &info)
+	StaticApplication(const Config &config, const DeviceInfo &info)
 		: m_config {config},
 		  m_info {info},
 		  m_finder {config.contacts()},
-		  m_dft {config, info}
+		  m_dft {config, info},
+		  m_stylus_predictor {config}
 	{
 		if (m_config.width == 0 || m_config.height == 0)
 			throw common::Error<Error::InvalidScreenSize> {};
 
-		m_parser.on_touch = [&](const auto &data) { this->process_touch(data); };
-		m_parser.on_stylus = [&](const auto &data) { this->process_stylus(data); };
-		m_parser.on_dft = [&](const auto &data) { this->process_dft(data); };
-		m_parser.on_button = [&](const auto &data) { this->process_button(data); };
+		const usize unpinned = m_finder.unpinned_threads();
+
+		if (unpinned > 0)
+			spdlog::warn("Failed to pin {} contact fitting threads to a CPU", unpinned);
 	}
 
-	virtual ~Application() = default;
+	// The parser keeps a reference to the application, which would be stale in a copy.
+	StaticApplication(const StaticApplication &) = delete;
+	StaticApplication &operator=(const StaticApplication &) = delete;
 
 	/*!
 	 * Parse and process an IPTS data buffer.
@@ -109,45 +256,153 @@ public:
 	 */
 	void process(const gsl::span<u8> data)
 	{
-		this->on_data(data);
+		this->derived().on_data(data);
+	}
+
+	/*!
+	 * How many heatmaps did not contain any activation, and skipped contact detection.
+	 *
+	 * @return The number of idle frames.
+	 */
+	[[nodiscard]] usize idle_frames() const
+	{
+		return m_idle_frames;
+	}
+
+	/*!
+	 * How many heatmaps were identical to the previous one, and skipped contact detection.
+	 *
+	 * @return The number of duplicate frames.
+	 */
+	[[nodiscard]] usize duplicate_frames() const
+	{
+		return m_duplicate_frames;
+	}
+
+	/*!
+	 * How many heatmaps were different from the previous one.
+	 *
+	 * @return The number of unique frames.
+	 */
+	[[nodiscard]] usize unique_frames() const
+	{
+		return m_unique_frames;
+	}
+
+	/*!
+	 * How many heatmaps skipped contact detection because the application didn't need them.
+	 *
+	 * @return The number of suspended frames.
+	 */
+	[[nodiscard]] usize suspended_frames() const
+	{
+		return m_suspended_frames;
+	}
+
+	/*!
+	 * How many heatmaps were never received, judging from the gaps between their timestamps.
+	 *
+	 * @return The number of missed frames.
+	 */
+	[[nodiscard]] usize missed_frames() const
+	{
+		return m_missed_frames;
 	}
 
 	/*!
 	 * For running application specific code after the runner has started.
 	 */
-	virtual void on_start() {};
+	void on_start() {};
 
 	/*!
 	 * For running application specific code after the runner has stopped.
 	 */
-	virtual void on_stop() {};
+	void on_stop() {};
 
 protected:
+	~StaticApplication() = default;
+
 	/*!
 	 * For replacing the parsing step of the data with application
 	 * specific code that operates on the entire incoming data.
+	 *
+	 * Stylus data is handled while parsing, heatmaps are only processed afterwards.
 	 */
-	virtual void on_data(const gsl::span<u8> data)
+	void on_data(const gsl::span<u8> data)
 	{
+		// Drop heatmaps that are left over from a report that failed to parse.
+		m_pending_touch.clear();
+
 		m_parser.parse(data);
+
+		for (const ipts::samples::Touch &touch : m_pending_touch)
+			this->process_touch(touch);
+
+		m_pending_touch.clear();
+	}
+
+	/*!
+	 * Changes whether the application needs the contacts from the heatmaps.
+	 *
+	 * Without demand, heatmaps are not normalized and no contact detection is done.
+	 * The application still receives an empty list of contacts for every heatmap.
+	 * Once contacts are needed again, all state from earlier frames is dropped,
+	 * so that detection starts from a fresh neutral value and with new indices.
+	 *
+	 * @param[in] demand Whether contacts are needed.
+	 */
+	void set_touch_demand(const bool demand)
+	{
+		if (m_touch_demand == demand)
+			return;
+
+		m_touch_demand = demand;
+
+		if (demand)
+			m_finder.reset();
+	}
+
+	/*!
+	 * Forgets the timestamps of earlier reports.
+	 *
+	 * The device time starts at zero again, and the interval between heatmaps is learned
+	 * from the following heatmaps. This is needed when the incoming data starts over,
+	 * because the jump between the timestamps would otherwise be counted as missed frames.
+	 */
+	void reset_timing()
+	{
+		m_timestamp = 0;
+		m_last_timestamp = std::nullopt;
+		m_last_frame = std::nullopt;
+		m_frame_interval = 0;
 	}
 
 	/*!
 	 * For running application specific code that further processes touch inputs.
 	 */
-	virtual void on_touch(const std::vector<contacts::Contact<f64>> & /* unused */) {};
+	void on_touch(const std::vector<contacts::Contact<f64>> & /* unused */) {};
 
 	/*!
 	 * For running application specific code that futher processes stylus inputs.
 	 */
-	virtual void on_stylus(const ipts::samples::Stylus & /* unused */) {};
+	void on_stylus(const ipts::samples::Stylus & /* unused */) {};
 
 	/*!
 	 * For running application specific code that further processes button clicks.
 	 */
-	virtual void on_button(const ipts::samples::Button & /* unused */) {};
+	void on_button(const ipts::samples::Button & /* unused */) {};
 
 private:
+	/*!
+	 * The application that extends this class.
+	 *
+	 * @return A reference to the derived application.
+	 */
+	Derived &derived()
+	{
+		return static_cast<Derived &>(*this);
+	}
+
 	/*!
 	 * Runs contact detection on an IPTS heatmap.
 	 *
@@ -164,6 +419,83 @@ private:
 		if (rows == 0 || cols == 0)
 			return;
 
+		this->update_timestamp(data.timestamp);
+		this->count_missed_frames(data.timestamp);
+
+		// Nobody needs the contacts, so don't search for them.
+		if (!m_touch_demand) {
+			m_suspended_frames++;
+			m_contacts.clear();
+
+			this->derived().on_touch(m_contacts);
+			return;
+		}
+
+		// Heatmaps that were already processed only need to go through tracking again
+		if (this->is_duplicate(data) && m_finder.repeat(m_contacts)) {
+			m_duplicate_frames++;
+		} else {
+			m_unique_frames++;
+			this->find_contacts(data);
+		}
+
+		// Invert contact coordinates if neccessary
+		for (contacts::Contact<f64> &contact : m_contacts) {
+			if (m_config.invert_x)
+				contact.mean.x() = 1.0 - contact.mean.x();
+
+			if (m_config.invert_y)
+				contact.mean.y() = 1.0 - contact.mean.y();
+
+			if (m_config.invert_x != m_config.invert_y)
+				contact.orientation = 1.0 - contact.orientation;
+		}
+
+		// Hand off the found contacts to the handler code.
+		this->derived().on_touch(m_contacts);
+	}
+
+	/*!
+	 * Checks if a heatmap is identical to the previous one.
+	 *
+	 * Some devices send the same heatmap multiple times while nothing changes. If the
+	 * heatmap is different, it is stored for comparing it with the next one.
+	 *
+	 * @param[in] data The heatmap to check.
+	 * @return Whether the heatmap and its metadata are identical to the previous heatmap.
+	 */
+	bool is_duplicate(const ipts::samples::Touch &data)
+	{
+		const usize size = casts::to_unsigned(data.rows * data.columns);
+		const gsl::span<const u8> heatmap = data.heatmap.subspan(0, size);
+
+		const bool duplicate = m_last_touch.rows == data.rows &&
+		                       m_last_touch.columns == data.columns &&
+		                       m_last_touch.min == data.min && m_last_touch.max == data.max &&
+		                       std::equal(heatmap.begin(), heatmap.end(), m_last_heatmap.begin());
+
+		if (duplicate)
+			return true;
+
+		m_last_heatmap.resize(size);
+		std::copy(heatmap.begin(), heatmap.end(), m_last_heatmap.begin());
+
+		m_last_touch = data;
+		m_last_touch.heatmap = m_last_heatmap;
+
+		return false;
+	}
+
+	/*!
+	 * Normalizes a heatmap and runs contact detection on it.
+	 *
+	 * @param[in] data The heatmap to process.
+	 */
+	void find_contacts(const ipts::samples::Touch &data)
+	{
+		const Eigen::Index rows = casts::to_eigen(data.rows);
+		const Eigen::Index cols = casts::to_eigen(data.columns);
+
 		// Make sure the heatmap buffer has the right size
 		if (m_heatmap.rows() != rows || m_heatmap.cols() != cols)
 			m_heatmap.conservativeResize(rows, cols);
@@ -174,6 +506,16 @@ private:
 		const auto min = casts::to<f64>(data.min);
 		const auto max = casts::to<f64>(data.max);
 
+		if (m_skip_idle_frames) {
+			// The lowest value of the inverted heatmap is the largest value after normalizing
+			const f64 peak = 1.0 - (casts::to<f64>(mapped.minCoeff()) - min) / (max - min);
+
+			if (m_finder.skip(peak, m_contacts)) {
+				m_idle_frames++;
+				return;
+			}
+		}
+
 		// Normalize the heatmap to range [0, 1]
 		const auto norm = (mapped.cast<f64>() - min) / (max - min);
 
@@ -183,20 +525,12 @@ private:
 		// Search for contacts
 		m_finder.find(m_heatmap, m_contacts);
 
-		// Invert contact coordinates if neccessary
-		for (contacts::Contact<f64> &contact : m_contacts) {
-			if (m_config.invert_x)
-				contact.mean.x() = 1.0 - contact.mean.x();
-
-			if (m_config.invert_y)
-				contact.mean.y() = 1.0 - contact.mean.y();
+		if (!m_warned_dropped && m_finder.dropped_contacts() > 0) {
+			spdlog::warn("Dropped contacts beyond the limit of {} per frame",
+				     contacts::ContactFrame<f64>::CAPACITY);
 
-			if (m_config.invert_x != m_config.invert_y)
-				contact.orientation = 1.0 - contact.orientation;
+			m_warned_dropped = true;
 		}
-
-		// Hand off the found contacts to the handler code.
-		this->on_touch(m_contacts);
 	}
 
 	/*!
@@ -209,6 +543,8 @@ private:
 		if (!m_info.is_touchscreen())
 			return;
 
+		this->update_timestamp(m_parser.timestamp());
+
 		ipts::samples::Stylus corrected = data;
 
 		// Correct position based on tip-transmitter distance
@@ -216,8 +552,11 @@ private:
 		corrected.x += off.x();
 		corrected.y += off.y();
 
+		// Extrapolate the corrected position, so that the offset is part of the movement.
+		m_stylus_predictor.predict(corrected);
+
 		// Hand off the stylus data to the handler code.
-		this->on_stylus(corrected);
+		this->derived().on_stylus(corrected);
 	}
 
 	/*!
@@ -257,7 +596,69 @@ private:
 		if (!m_info.is_touchpad())
 			return;
 
-		this->on_button(data);
+		this->update_timestamp(m_parser.timestamp());
+		this->derived().on_button(data);
+	}
+
+	/*!
+	 * Advances the device time to the timestamp of a report.
+	 *
+	 * The timestamps of the reports are too short to be used directly, because they
+	 * wrap around every 6.5 seconds. Instead, the difference to the last report is added
+	 * to a longer running clock.
+	 *
+	 * @param[in] timestamp The timestamp of the report, in units of 100μs.
+	 */
+	void update_timestamp(const u16 timestamp)
+	{
+		const std::optional<u16> last = std::exchange(m_last_timestamp, timestamp);
+
+		if (!last.has_value())
+			return;
+
+		const auto delta = casts::to<u32>(gsl::narrow_cast<u16>(timestamp - last.value()));
+
+		// Unsigned overflow is well defined, the clock is expected to wrap around.
+		m_timestamp += delta * 100;
+	}
+
+	/*!
+	 * Counts how many heatmaps were lost between the last and the current heatmap.
+	 *
+	 * The interval between two heatmaps is learned from the timestamps of the heatmaps.
+	 * If the gap to the last heatmap spans multiple intervals, the heatmaps in between
+	 * were lost.
+	 *
+	 * @param[in] timestamp The timestamp of the current heatmap, in units of 100μs.
+	 */
+	void count_missed_frames(const u16 timestamp)
+	{
+		const std::optional<u16> last = std::exchange(m_last_frame, timestamp);
+
+		if (!last.has_value())
+			return;
+
+		const auto delta = casts::to<f64>(gsl::narrow_cast<u16>(timestamp - last.value()));
+
+		// Devices without timestamps always report 0.
+		if (delta == 0)
+			return;
+
+		if (m_frame_interval == 0) {
+			m_frame_interval = delta;
+			return;
+		}
+
+		const f64 frames = std::round(delta / m_frame_interval);
+
+		if (frames > MAX_MISSED_FRAMES)
+			return;
+
+		if (frames > 1)
+			m_missed_frames += casts::to<usize>(frames) - 1;
+
+		// Follow slow changes of the frame rate.
+		m_frame_interval += (delta / std::max(frames, 1.0) - m_frame_interval) * 0.1;
 	}
 
 	/*!
@@ -291,6 +692,61 @@ private:
 	}
 };
 
+/*
+ * An application whose methods can be overridden at runtime.
+ *
+ * This is the classic interface of @ref StaticApplication, where all methods that can
+ * be replaced by the application are virtual. It is meant for tools where the cost of
+ * calling a virtual function for every sample doesn't matter.
+ */
+class Application : public StaticApplication<Application> {
+private:
+	friend class StaticApplication<Application>;
+
+public:
+	Application(const Config &config, const DeviceInfo &info)
+		: StaticApplication<Application>(config, info) {};
+
+	virtual ~Application() = default;
+
+	/*!
+	 * For running application specific code after the runner has started.
+	 */
+	virtual void on_start() {};
+
+	/*!
+	 * For running application specific code after the runner has stopped.
+	 */
+	virtual void on_stop() {};
+
+protected:
+	/*!
+	 * For replacing the parsing step of the data with application
+	 * specific code that operates on the entire incoming data.
+	 *
+	 * Stylus data is handled while parsing, heatmaps are only processed afterwards.
+	 */
+	virtual void on_data(const gsl::span<u8> data)
+	{
+		StaticApplication::on_data(data);
+	}
+
+	/*!
+	 * For running application specific code that further processes touch inputs.
+	 */
+	virtual void on_touch(const std::vector<contacts::Contact<f64>> & /* unused */) {};
+
+	/*!
+	 * For running application specific code that futher processes stylus inputs.
+	 */
+	virtual void on_stylus(const ipts::samples::Stylus & /* unused */) {};
+
+	/*!
+	 * For running application specific code that further processes button clicks.
+	 */
+	virtual void on_button(const ipts::samples::Button & /* unused */) {};
+};
+
 } // namespace iptsd::core
 
 #endif // IPTSD_CORE_GENERIC_APPLICATION_HPP
@@ -40,20 +40,36 @@ public:
 	f64 contacts_neutral_value = 0;
 	f64 contacts_activation_threshold = 40;
 	f64 contacts_deactivation_threshold = 36;
+	std::string contacts_estimator = "gaussian";
+	bool contacts_incremental = false;
+	bool contacts_pyramid = false;
+	f64 contacts_tracking_distance_max = 0;
+	bool contacts_prediction = false;
+	f64 contacts_prediction_horizon = 0;
 	f64 contacts_size_thresh_min = 0.1;
 	f64 contacts_size_thresh_max = 0.5;
 	f64 contacts_position_thresh_min = 0.04;
 	f64 contacts_position_thresh_max = 2;
 	f64 contacts_orientation_thresh_min = 1;
 	f64 contacts_orientation_thresh_max = 15;
+	bool contacts_smoothing = false;
+	f64 contacts_smoothing_min_cutoff = 0.01;
+	f64 contacts_smoothing_beta = 0.5;
+	f64 contacts_smoothing_orientation_beta = 0.02;
 	f64 contacts_size_min = 0.2;
 	f64 contacts_size_max = 2;
 	f64 contacts_aspect_min = 1;
 	f64 contacts_aspect_max = 2.5;
+	usize contacts_fitting_iterations = 3;
+	f64 contacts_fitting_tolerance = 0.01;
+	bool contacts_fitting_warm_start = true;
+	usize contacts_fitting_threads = 0;
+	usize contacts_fitting_threads_threshold = 4;
 
 	// [Stylus]
 	bool stylus_disable = false;
 	f64 stylus_tip_distance = 0;
+	f64 stylus_prediction_horizon = 0;
 
 	// [DFT]
 	usize dft_position_min_amp = 50;
@@ -95,13 +111,52 @@ public:
 		else
 			throw common::Error<Error::InvalidNeutralValueAlgorithm> {};
 
+		using Estimator = contacts::detection::Estimator;
+
+		if (this->contacts_estimator == "gaussian")
+			config.detection.estimator = Estimator::GAUSSIAN;
+		else if (this->contacts_estimator == "moments")
+			config.detection.estimator = Estimator::MOMENTS;
+		else if (this->contacts_estimator == "hybrid")
+			config.detection.estimator = Estimator::HYBRID;
+		else
+			throw common::Error<Error::InvalidContactEstimator> {};
+
 		const f64 nval_offset = this->contacts_neutral_value;
 
 		config.detection.neutral_value_offset = nval_offset / 255.0;
 		config.detection.neutral_value_backoff = 16; // TODO: config option
 
+		config.detection.incremental = this->contacts_incremental;
+		config.detection.pyramid = this->contacts_pyramid;
+
+		config.detection.fitting_iterations = this->contacts_fitting_iterations;
+		config.detection.fitting_tolerance = this->contacts_fitting_tolerance;
+		config.detection.fitting_warm_start = this->contacts_fitting_warm_start;
+
+		config.detection.fitting_threads = this->contacts_fitting_threads;
+		config.detection.fitting_threads_threshold =
+			this->contacts_fitting_threads_threshold;
+
 		const f64 diagonal = std::hypot(this->width, this->height);
 
+		/*
+		 * Clusters that are a lot larger than the maximum size are certain to be invalid,
+		 * even with the inaccuracy of estimating their size from the cluster moments.
+		 */
+		config.detection.rejection_size = this->contacts_size_max * 1.5 / diagonal;
+
+		const f64 tracking_distance = this->contacts_tracking_distance_max;
+
+		// Measure the distances between contacts in centimeters, like the limit.
+		config.tracking.scale = Vector2<f64> {this->width, this->height};
+
+		if (tracking_distance > 0)
+			config.tracking.max_distance = tracking_distance;
+
+		config.prediction.enable = this->contacts_prediction;
+		config.prediction.horizon = this->contacts_prediction_horizon;
+
 		config.validation.track_validity = true;
 		config.validation.size_limits = Vector2<f64> {
 			this->contacts_size_min / diagonal,
@@ -125,6 +180,24 @@ public:
 			this->contacts_orientation_thresh_max / 180,
 		};
 
+		if (this->contacts_smoothing) {
+			const f64 cutoff = this->contacts_smoothing_min_cutoff;
+			const f64 beta = this->contacts_smoothing_beta;
+
+			// Measure the speed of the position in centimeters, like the config.
+			config.stability.scale = Vector2<f64> {this->width, this->height};
+
+			// The size is normalized to the diagonal of the screen.
+			const f64 sbeta = beta * diagonal;
+
+			// The speed of the orientation is normalized, the config is in degrees.
+			const f64 obeta = this->contacts_smoothing_orientation_beta * 180;
+
+			config.stability.position_smoothing = Vector2<f64> {cutoff, beta};
+			config.stability.size_smoothing = Vector2<f64> {cutoff, sbeta};
+			config.stability.orientation_smoothing = Vector2<f64> {cutoff, obeta};
+		}
+
 		return config;
 	}
 };
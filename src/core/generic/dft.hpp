@@ -7,6 +7,8 @@
 #include "device.hpp"
 
 #include <common/casts.hpp>
+#include <common/fastmath.hpp>
+#include <common/types.hpp>
 #include <ipts/metadata.hpp>
 #include <ipts/protocol/dft.hpp>
 #include <ipts/samples/dft.hpp>
@@ -14,6 +16,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <numeric>
 #include <optional>
 #include <utility>
 
@@ -27,6 +30,9 @@ private:
 	// The current state of the DFT stylus.
 	ipts::samples::Stylus m_stylus;
 
+	// Raises the antenna amplitudes to the power of dft_position_exp.
+	common::fastmath::Pow m_position_pow;
+
 	i32 m_real = 0;
 	i32 m_imag = 0;
 	std::optional<u32> m_group = std::nullopt;
@@ -48,7 +54,8 @@ private:
 public:
 	DftStylus(Config config, const DeviceInfo &info)
 		: m_config {std::move(config)},
-		  m_info {info} {};
+		  m_info {info},
+		  m_position_pow {m_config.dft_position_exp} {};
 
 	/*!
 	 * Loads a DFT window and calculates stylus properties from it.
@@ -174,8 +181,12 @@ private:
 				xt *= m_config.width / m_config.dft_tilt_distance;
 				yt *= m_config.height / m_config.dft_tilt_distance;
 
-				const f64 azm = std::fmod(std::atan2(-yt, xt) + 2 * M_PI, 2 * M_PI);
-				const f64 alt = std::asin(std::min(1.0, std::hypot(xt, yt)));
+				const f64 angle = common::fastmath::atan2(-yt, xt);
+				const f64 dist = std::sqrt(xt * xt + yt * yt);
+
+				// Map the azimuth to [0, 2pi)
+				const f64 azm = angle < 0 ? angle + 2 * M_PI : angle;
+				const f64 alt = common::fastmath::asin(std::min(1.0, dist));
 
 				m_stylus.azimuth = azm;
 				m_stylus.altitude = alt;
@@ -330,14 +341,17 @@ private:
 			maxd = 1;
 		}
 
+		const auto real = casts::to<f64>(row.real.at(maxi));
+		const auto imag = casts::to<f64>(row.imag.at(maxi));
+
 		// get phase-aligned amplitudes of the three center components
-		const f64 amp = std::hypot(row.real.at(maxi), row.imag.at(maxi));
+		const f64 amp = std::sqrt(real * real + imag * imag);
 
 		if (amp < casts::to<f64>(m_config.dft_position_min_amp))
 			return casts::to<f64>(NAN);
 
-		const f64 sin = row.real.at(maxi) / amp;
-		const f64 cos = row.imag.at(maxi) / amp;
+		const f64 sin = real / amp;
+		const f64 cos = imag / amp;
 
 		std::array<f64, 3> x = {
 			sin * row.real.at(maxi - 1) + cos * row.imag.at(maxi - 1),
@@ -347,7 +361,7 @@ private:
 
 		// convert the amplitudes into something we can fit a parabola to
 		for (u8 i = 0; i < 3; i++)
-			x.at(i) = std::pow(x.at(i), m_config.dft_position_exp);
+			x.at(i) = m_position_pow(x.at(i));
 
 		// check orientation of fitted parabola
 		if (x[0] + x[2] <= 2 * x[1])
@@ -359,6 +373,13 @@ private:
 		return row.first + maxi + std::clamp(d, mind, maxd);
 	}
 
+	/*!
+	 * Interpolates the frequency of the stylus signal from the rows of a DFT window.
+	 *
+	 * @param[in] dft The DFT window.
+	 * @param[in] rows How many rows of the window are used.
+	 * @return The position of the frequency between the first and the last row, in [0, 1].
+	 */
 	[[nodiscard]] f64 interpolate_frequency(const ipts::samples::DftWindow &dft,
 	                                        const u8 rows) const
 	{
@@ -399,17 +420,12 @@ private:
 		std::array<i32, 3> real {};
 		std::array<i32, 3> imag {};
 
-		for (u8 i = 0; i < 3; i++) {
-			real.at(i) = 0;
-			imag.at(i) = 0;
-
-			for (u8 j = 0; j < ipts::protocol::dft::NUM_COMPONENTS; j++) {
-				const ipts::protocol::dft::Row &x = dft.x[maxi + i - 1];
-				const ipts::protocol::dft::Row &y = dft.y[maxi + i - 1];
+		for (usize i = 0; i < 3; i++) {
+			const ipts::protocol::dft::Row &x = dft.x[maxi + i - 1];
+			const ipts::protocol::dft::Row &y = dft.y[maxi + i - 1];
 
-				real.at(i) += x.real.at(j) + y.real.at(j);
-				imag.at(i) += x.imag.at(j) + y.imag.at(j);
-			}
+			real[i] = DftStylus::sum(x.real) + DftStylus::sum(y.real);
+			imag[i] = DftStylus::sum(x.imag) + DftStylus::sum(y.imag);
 		}
 
 		// interpolate using Eric Jacobsen's modified quadratic estimator
@@ -423,6 +439,18 @@ private:
 		return (maxi + std::clamp(d, mind, maxd)) / (rows - 1);
 	}
 
+	/*!
+	 * Adds up the real or imaginary components of a row.
+	 *
+	 * @param[in] row The real or imaginary components of a row.
+	 * @return The sum of all components.
+	 */
+	[[nodiscard]] static i32
+	sum(const std::array<i16, ipts::protocol::dft::NUM_COMPONENTS> &row)
+	{
+		return std::accumulate(row.begin(), row.end(), i32 {0});
+	}
+
 	/*!
 	 * Marks the DFT stylus as lifted.
 	 */
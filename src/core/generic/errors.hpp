@@ -12,6 +12,7 @@ namespace iptsd::core {
 enum class Error : u8 {
 	InvalidScreenSize,
 	InvalidNeutralValueAlgorithm,
+	InvalidContactEstimator,
 };
 
 inline std::string format_as(Error err)
@@ -21,6 +22,8 @@ inline std::string format_as(Error err)
 		return "core: The screen size is 0! Is your device supported?";
 	case Error::InvalidNeutralValueAlgorithm:
 		return "core: The selected neutral value algorithm is invalid!";
+	case Error::InvalidContactEstimator:
+		return "core: The selected contact estimator is invalid!";
 	default:
 		return "core: Invalid error code!";
 	}
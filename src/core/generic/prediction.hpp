@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IPTSD_CORE_GENERIC_PREDICTION_HPP
+#define IPTSD_CORE_GENERIC_PREDICTION_HPP
+
+#include "config.hpp"
+
+#include <common/fastmath.hpp>
+#include <common/types.hpp>
+#include <ipts/samples/stylus.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <utility>
+
+namespace iptsd::core {
+
+/*
+ * Extrapolates the position of the stylus, to reduce the perceived latency.
+ *
+ * The velocity and acceleration of the stylus are estimated from the last three samples.
+ * The acceleration is smoothed over multiple samples, because it amplifies the noise of the
+ * measured positions. The smoothing starts at zero, so a single noisy sample can't produce a
+ * large acceleration. How far a position can be moved is limited by the speed of the stylus.
+ *
+ * Whenever the movement of the stylus becomes discontinuous (it touches or leaves the screen,
+ * a button is pressed, or the tilt jumps), the recent samples are forgotten and the measured
+ * position is reported until enough new samples have arrived.
+ */
+class StylusPredictor {
+private:
+	/*
+	 * If the tilt of the stylus moves further than this between two samples, the movement
+	 * is not extrapolated. The tilt is the projection of the stylus onto the screen, with
+	 * a length of 1 if the stylus is lying flat.
+	 */
+	constexpr static f64 MAX_TILT_CHANGE = 0.2;
+
+	/*
+	 * How much a new sample changes the smoothed acceleration.
+	 */
+	constexpr static f64 ACCELERATION_SMOOTHING = 0.1;
+
+	/*
+	 * A position is moved at most this many times as far as the stylus would move
+	 * at its current speed until the end of the horizon.
+	 */
+	constexpr static f64 MAX_OVERSHOOT = 1.5;
+
+private:
+	Config m_config;
+
+	// The positions of the recent samples, the newest one first.
+	std::array<Vector2<f64>, 3> m_positions {};
+
+	// How many of the recent positions are known.
+	usize m_count = 0;
+
+	// The smoothed acceleration, in units per sample squared.
+	Vector2<f64> m_acceleration = Vector2<f64>::Zero();
+
+	// The last sample that was passed to the predictor.
+	std::optional<ipts::samples::Stylus> m_last = std::nullopt;
+
+public:
+	StylusPredictor(Config config) : m_config {std::move(config)} {};
+
+	/*!
+	 * Whether the position of the stylus is extrapolated.
+	 *
+	 * @return Whether the predictor is enabled.
+	 */
+	[[nodiscard]] bool enabled() const
+	{
+		return m_config.stylus_prediction_horizon > 0;
+	}
+
+	/*!
+	 * Forgets the recent movement of the stylus.
+	 */
+	void reset()
+	{
+		m_count = 0;
+		m_last = std::nullopt;
+		m_acceleration = Vector2<f64>::Zero();
+	}
+
+	/*!
+	 * Replaces the position of a stylus sample with its predicted position.
+	 *
+	 * @param[in,out] stylus The sample to extrapolate.
+	 */
+	void predict(ipts::samples::Stylus &stylus)
+	{
+		if (!this->enabled())
+			return;
+
+		if (!m_last.has_value() || !StylusPredictor::is_continuous(m_last.value(), stylus))
+			this->reset();
+
+		m_last = stylus;
+
+		if (!stylus.proximity) {
+			this->reset();
+			return;
+		}
+
+		const Vector2<f64> position {stylus.x, stylus.y};
+
+		// Split DFT events can repeat the last position, which is not a new sample.
+		if (m_count == 0 || position != m_positions[0])
+			this->push(position);
+
+		if (m_count < 2)
+			return;
+
+		const f64 horizon = m_config.stylus_prediction_horizon;
+
+		// The difference of the last two positions is the velocity half a sample ago.
+		const Vector2<f64> delta = m_positions[0] - m_positions[1];
+
+		Vector2<f64> velocity = delta;
+		Vector2<f64> acceleration = Vector2<f64>::Zero();
+
+		if (m_count >= 3) {
+			acceleration = m_acceleration;
+			velocity += acceleration * 0.5;
+		}
+
+		Vector2<f64> offset = velocity * horizon + acceleration * (0.5 * horizon * horizon);
+
+		const f64 limit = delta.norm() * horizon * MAX_OVERSHOOT;
+		const f64 distance = offset.norm();
+
+		if (distance > limit)
+			offset *= limit / distance;
+
+		stylus.x = std::clamp(position.x() + offset.x(), 0.0, 1.0);
+		stylus.y = std::clamp(position.y() + offset.y(), 0.0, 1.0);
+	}
+
+private:
+	/*!
+	 * Adds a new position to the recent samples and updates the smoothed acceleration.
+	 *
+	 * @param[in] position The measured position of the stylus.
+	 */
+	void push(const Vector2<f64> &position)
+	{
+		std::move_backward(m_positions.begin(), m_positions.end() - 1, m_positions.end());
+		m_positions[0] = position;
+		m_count = std::min(m_count + 1, m_positions.size());
+
+		if (m_count < 3)
+			return;
+
+		// The second difference of the last three positions.
+		const Vector2<f64> first = m_positions[0] - m_positions[1];
+		const Vector2<f64> acceleration = first - (m_positions[1] - m_positions[2]);
+
+		m_acceleration += (acceleration - m_acceleration) * ACCELERATION_SMOOTHING;
+	}
+
+	/*!
+	 * Checks whether the stylus moved continuously between two samples.
+	 *
+	 * @param[in] last The previous sample.
+	 * @param[in] current The current sample.
+	 * @return Whether the movement between the samples can be extrapolated.
+	 */
+	[[nodiscard]] static bool is_continuous(const ipts::samples::Stylus &last,
+	                                        const ipts::samples::Stylus &current)
+	{
+		if (last.proximity != current.proximity || last.contact != current.contact)
+			return false;
+
+		if (last.button != current.button || last.rubber != current.rubber)
+			return false;
+
+		const Vector2<f64> from = StylusPredictor::tilt(last);
+		const Vector2<f64> to = StylusPredictor::tilt(current);
+
+		return (to - from).squaredNorm() <= MAX_TILT_CHANGE * MAX_TILT_CHANGE;
+	}
+
+	/*!
+	 * Projects the stylus onto the screen.
+	 *
+	 * Comparing the projection instead of the angles avoids false jumps of the azimuth,
+	 * which is not meaningful when the stylus is held upright.
+	 *
+	 * @param[in] stylus The stylus sample.
+	 * @return The direction of the stylus, scaled by the sine of its altitude.
+	 */
+	[[nodiscard]] static Vector2<f64> tilt(const ipts::samples::Stylus &stylus)
+	{
+		f64 sin = 0;
+		f64 cos = 0;
+
+		common::fastmath::sincos(stylus.azimuth, sin, cos);
+		return Vector2<f64> {cos, sin} * std::sin(stylus.altitude);
+	}
+};
+
+} // namespace iptsd::core
+
+#endif // IPTSD_CORE_GENERIC_PREDICTION_HPP
@@ -165,19 +165,38 @@ private:
 		this->get(ini, "Contacts", "NeutralValue", m_config.contacts_neutral_value);
 		this->get(ini, "Contacts", "ActivationThreshold", m_config.contacts_activation_threshold);
 		this->get(ini, "Contacts", "DeactivationThreshold", m_config.contacts_deactivation_threshold);
+		this->get(ini, "Contacts", "Estimator", m_config.contacts_estimator);
+		this->get(ini, "Contacts", "Incremental", m_config.contacts_incremental);
+		this->get(ini, "Contacts", "Pyramid", m_config.contacts_pyramid);
+		this->get(ini, "Contacts", "TrackingDistanceMax", m_config.contacts_tracking_distance_max);
+		this->get(ini, "Contacts", "Prediction", m_config.contacts_prediction);
+		this->get(ini, "Contacts", "PredictionHorizon", m_config.contacts_prediction_horizon);
 		this->get(ini, "Contacts", "SizeThresholdMin", m_config.contacts_size_thresh_min);
 		this->get(ini, "Contacts", "SizeThresholdMax", m_config.contacts_size_thresh_max);
 		this->get(ini, "Contacts", "PositionThresholdMin", m_config.contacts_position_thresh_min);
 		this->get(ini, "Contacts", "PositionThresholdMax", m_config.contacts_position_thresh_max);
 		this->get(ini, "Contacts", "OrientationThresholdMin", m_config.contacts_orientation_thresh_min);
 		this->get(ini, "Contacts", "OrientationThresholdMax", m_config.contacts_orientation_thresh_max);
+		this->get(ini, "Contacts", "Smoothing", m_config.contacts_smoothing);
+		this->get(ini, "Contacts", "SmoothingMinCutoff", m_config.contacts_smoothing_min_cutoff);
+		this->get(ini, "Contacts", "SmoothingBeta", m_config.contacts_smoothing_beta);
+		this->get(ini, "Contacts", "SmoothingOrientationBeta", m_config.contacts_smoothing_orientation_beta);
 		this->get(ini, "Contacts", "SizeMin", m_config.contacts_size_min);
 		this->get(ini, "Contacts", "SizeMax", m_config.contacts_size_max);
 		this->get(ini, "Contacts", "AspectMin", m_config.contacts_aspect_max);
 		this->get(ini, "Contacts", "AspectMax", m_config.contacts_aspect_max);
+		this->get(ini, "Contacts", "FittingIterations", m_config.contacts_fitting_iterations);
+		this->get(ini, "Contacts", "FittingTolerance", m_config.contacts_fitting_tolerance);
+		this->get(ini, "Contacts", "FittingWarmStart", m_config.contacts_fitting_warm_start);
+		this->get(ini, "Contacts", "FittingThreads", m_config.contacts_fitting_threads);
+		this->get(ini,
+		          "Contacts",
+		          "FittingThreadsThreshold",
+		          m_config.contacts_fitting_threads_threshold);
 
 		this->get(ini, "Stylus", "Disable", m_config.stylus_disable);
 		this->get(ini, "Stylus", "TipDistance", m_config.stylus_tip_distance);
+		this->get(ini, "Stylus", "PredictionHorizon", m_config.stylus_prediction_horizon);
 
 		this->get(ini, "DFT", "PositionMinAmp", m_config.dft_position_min_amp);
 		this->get(ini, "DFT", "PositionMinMag", m_config.dft_position_min_mag);
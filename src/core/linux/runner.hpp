@@ -28,13 +28,15 @@ namespace iptsd::core::linux {
  * The application runner is responsible for connecting a generic application with the
  * hardware and platform specific implementation details.
  *
- * @tparam App The application type that is being run.
+ * @tparam App The application type that is being run. Must extend @ref Application or
+ *             @ref StaticApplication of itself.
  * @tparam Device The type that implements the HID data source.
  */
 template <class App, class Device>
 class Runner {
 private:
-	static_assert(std::is_base_of_v<Application, App>);
+	static_assert(std::disjunction_v<std::is_base_of<Application, App>,
+	                                 std::is_base_of<StaticApplication<App>, App>>);
 	static_assert(std::is_base_of_v<hid::Device, Device>);
 
 private:
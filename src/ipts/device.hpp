@@ -15,7 +15,6 @@
 #include <gsl/gsl>
 
 #include <algorithm>
-#include <functional>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -138,8 +137,6 @@ public:
 	 */
 	[[nodiscard]] std::optional<const Metadata> metadata() const
 	{
-		std::optional<Metadata> metadata = std::nullopt;
-
 		const std::optional<hid::Report> report = m_descriptor.find_metadata_report();
 		if (!report.has_value())
 			return std::nullopt;
@@ -153,11 +150,19 @@ public:
 
 		m_hid->get_feature(buffer);
 
-		Parser parser {};
-		parser.on_metadata = [&](const Metadata &m) { metadata = m; };
+		struct Handler : public IgnoreSamples {
+			std::optional<Metadata> metadata = std::nullopt;
+
+			void on_metadata(const Metadata &m)
+			{
+				metadata = m;
+			}
+		} handler {};
+
+		Parser<Handler> parser {handler};
 		parser.parse<u8>(buffer);
 
-		return metadata;
+		return handler.metadata;
 	}
 
 	/*!
@@ -23,33 +23,61 @@
 
 #include <gsl/gsl>
 
-#include <functional>
 #include <optional>
 
 namespace iptsd::ipts {
 
-class Parser {
+/*!
+ * A handler for the parser that ignores all data.
+ *
+ * Handlers can inherit from this and only define the callbacks for the data they need.
+ */
+struct IgnoreSamples {
 public:
-	// The callback that is invoked when stylus data was parsed.
-	std::function<void(const samples::Stylus &)> on_stylus;
+	// Invoked when stylus data was parsed.
+	void on_stylus(const samples::Stylus & /* unused */) {};
 
-	// The callback that is invoked when a capacitive heatmap was parsed.
-	std::function<void(const samples::Touch &)> on_touch;
+	// Invoked when a capacitive heatmap was parsed.
+	void on_touch(const samples::Touch & /* unused */) {};
 
-	// The callback that is invoked when a DFT window was parsed.
-	std::function<void(const samples::DftWindow &)> on_dft;
+	// Invoked when a DFT window was parsed.
+	void on_dft(const samples::DftWindow & /* unused */) {};
 
-	// The callback that is invoked when a button sample was parsed.
-	std::function<void(const samples::Button &)> on_button;
+	// Invoked when a button sample was parsed.
+	void on_button(const samples::Button & /* unused */) {};
 
-	// The callback that is invoked when a metadata report was parsed.
-	std::function<void(const Metadata &)> on_metadata;
+	// Invoked when a metadata report was parsed.
+	void on_metadata(const Metadata & /* unused */) {};
+};
 
+/*!
+ * Parses the data from IPTS devices.
+ *
+ * The parsed data is passed to the callbacks of a handler object. Because the type of the
+ * handler is known at compile time, the callbacks can be inlined into the parser.
+ *
+ * @tparam Handler The type that receives the parsed data, see @ref IgnoreSamples.
+ */
+template <class Handler>
+class Parser {
 private:
+	// Receives the data that was parsed.
+	Handler &m_handler;
+
 	protocol::heatmap::Dimensions m_dim {};
 	protocol::dft::Metadata m_dft_meta {};
 
+	// The timestamp from the header of the data that is currently being parsed.
+	u16 m_timestamp = 0;
+
 public:
+	/*!
+	 * Creates a parser that passes the parsed data to a handler.
+	 *
+	 * @param[in] handler The object whose callbacks are invoked. Must outlive the parser.
+	 */
+	explicit Parser(Handler &handler) : m_handler {handler} {};
+
 	/*!
 	 * Parses IPTS touch data from a HID report buffer.
 	 *
@@ -59,7 +87,12 @@ public:
 	 */
 	void parse(const gsl::span<u8> data)
 	{
-		this->parse<protocol::hid::ReportHeader>(data);
+		Reader reader(data);
+
+		const auto header = reader.read<protocol::hid::ReportHeader>();
+		m_timestamp = header.timestamp;
+
+		this->parse_hid_frame(reader);
 	}
 
 	/*!
@@ -74,12 +107,26 @@ public:
 		this->parse_with_header(data, sizeof(T));
 	}
 
+	/*!
+	 * The timestamp from the header of the data that is currently being parsed.
+	 *
+	 * The timestamp is counted by the device, in units of 100μs, and wraps around.
+	 * It is only known if the data has a HID report header, otherwise it is 0.
+	 *
+	 * @return The timestamp of the current report.
+	 */
+	[[nodiscard]] u16 timestamp() const
+	{
+		return m_timestamp;
+	}
+
 private:
 	void parse_with_header(const gsl::span<u8> data, const usize header)
 	{
 		Reader reader(data);
 		reader.skip(header);
 
+		m_timestamp = 0;
 		this->parse_hid_frame(reader);
 	}
 
@@ -174,7 +221,7 @@ private:
 	 * Parses an IPTS metadata frame.
 	 *
 	 * Metadata frames are returned by a HID feature report on devices that natively support
-	 * HID. Once the data is parsed, the @ref on_metadata callback will be invoked.
+	 * HID. Once the data is parsed, the on_metadata callback of the handler is invoked.
 	 *
 	 * @param[in] reader The chunk of data allocated to the metadata frame.
 	 */
@@ -195,8 +242,7 @@ private:
 		meta.invert_x = frame.transform.xx < 0;
 		meta.invert_y = frame.transform.yy < 0;
 
-		if (this->on_metadata)
-			this->on_metadata(meta);
+		m_handler.on_metadata(meta);
 	}
 
 	/*!
@@ -271,9 +317,6 @@ private:
 
 		const auto sample = reader.read<protocol::stylus::SampleMPP_1_0>();
 
-		if (!this->on_stylus)
-			return;
-
 		samples::Stylus stylus {};
 		stylus.proximity = sample.state.proximity;
 		stylus.button = sample.state.button;
@@ -294,7 +337,7 @@ private:
 		stylus.azimuth = 0;
 		stylus.timestamp = 0;
 
-		this->on_stylus(stylus);
+		m_handler.on_stylus(stylus);
 	}
 
 	/*!
@@ -317,9 +360,6 @@ private:
 
 		const auto sample = reader.read<protocol::stylus::SampleMPP_1_51>();
 
-		if (!this->on_stylus)
-			return;
-
 		samples::Stylus stylus {};
 		stylus.timestamp = sample.timestamp;
 
@@ -344,7 +384,7 @@ private:
 		stylus.altitude /= 18000.0 / M_PI;
 		stylus.azimuth /= 18000.0 / M_PI;
 
-		this->on_stylus(stylus);
+		m_handler.on_stylus(stylus);
 	}
 
 	/*!
@@ -384,11 +424,11 @@ private:
 		touch.columns = m_dim.columns;
 		touch.min = m_dim.z_min;
 		touch.max = m_dim.z_max;
+		touch.timestamp = m_timestamp;
 
 		touch.heatmap = reader.subspan<u8>(casts::to<usize>(m_dim.rows) * m_dim.columns);
 
-		if (this->on_touch)
-			this->on_touch(touch);
+		m_handler.on_touch(touch);
 	}
 
 	/*!
@@ -434,8 +474,7 @@ private:
 			dft.group = casts::unpack(m_dft_meta.group_counter);
 		}
 
-		if (this->on_dft)
-			this->on_dft(dft);
+		m_handler.on_dft(dft);
 	}
 
 	/*!
@@ -474,8 +513,7 @@ private:
 			button.active = sample.button;
 		}
 
-		if (this->on_button)
-			this->on_button(button);
+		m_handler.on_button(button);
 	}
 };
 